@@ -0,0 +1,157 @@
+
+#include "lu/status.h"
+#include "lu/log.h"
+
+#include "codec.h"
+#include "profile.h"
+
+
+// the packed layout, from the lsb: the group (2 bits, A=1 to C=3), the
+// padding (4 bits), the number of named offsets (4 bits), then each
+// offset (5 bits, two's complement).
+
+#define TYPE_BITS 2
+#define PADDING_BITS 4
+#define NAMED_BITS 4
+#define OFFSET_BITS 5
+#define PADDING_SHIFT TYPE_BITS
+#define NAMED_SHIFT (PADDING_SHIFT + PADDING_BITS)
+#define OFFSET_SHIFT (NAMED_SHIFT + NAMED_BITS)
+#define MASK(bits) ((1 << (bits)) - 1)
+#define FIELD(p, shift, bits) ((int)(((p) >> (shift)) & MASK(bits)))
+
+char packed_type(packed p) {
+    return 'A' - 1 + FIELD(p, 0, TYPE_BITS);
+}
+
+int packed_named(packed p) {
+    return FIELD(p, NAMED_SHIFT, NAMED_BITS);
+}
+
+int packed_padding(packed p) {
+    return FIELD(p, PADDING_SHIFT, PADDING_BITS);
+}
+
+int packed_offset(packed p, int i) {
+    int offset = FIELD(p, OFFSET_SHIFT + i * OFFSET_BITS, OFFSET_BITS);
+    return offset & (1 << (OFFSET_BITS - 1)) ? offset - (1 << OFFSET_BITS) : offset;
+}
+
+int pack_offsets(char type, const int *offsets, int n, int padding, packed *p) {
+    if (type < 'A' || type > 'C' || n < 1 || n > PACKED_MAX_NAMED || padding < 0 || padding > 9) return LU_ERR_ARG;
+    *p = (packed)(type - 'A' + 1) | (packed)padding << PADDING_SHIFT | (packed)n << NAMED_SHIFT;
+    for (int i = 0; i < n; ++i) {
+        if (offsets[i] < -9 || offsets[i] > 9) return LU_ERR_ARG;
+        *p |= (packed)(offsets[i] & MASK(OFFSET_BITS)) << (OFFSET_SHIFT + i * OFFSET_BITS);
+    }
+    return LU_OK;
+}
+
+// a single pass, with the same rules as the old unpack() (',' resets
+// the sign, each '-' negates it).
+int parse_name(const char *name, packed *p, const char **end) {
+
+    const char *c = name;
+    int sign = 1, n = 0, padding = 0;
+    packed offsets = 0;
+
+    while (*c < 'A' || *c > 'C') {
+        if (*c == ',') {
+            sign = 1;
+        } else if (*c == '-') {
+            sign = -sign;
+        } else if (*c >= '0' && *c <= '9' && n < PACKED_MAX_NAMED) {
+            offsets |= (packed)((sign * (*c - '0')) & MASK(OFFSET_BITS)) << (OFFSET_SHIFT + n++ * OFFSET_BITS);
+            sign = 1;
+        } else {
+            return LU_ERR_ARG;
+        }
+        c++;
+    }
+    if (!n) return LU_ERR_ARG;
+    char type = *c++;
+    if (*c >= '0' && *c <= '9') padding = *c++ - '0';
+
+    *p = (packed)(type - 'A' + 1) | (packed)padding << PADDING_SHIFT | (packed)n << NAMED_SHIFT | offsets;
+    if (end) *end = c;
+    return LU_OK;
+}
+
+int format_name(packed p, char *name) {
+    char *c = name;
+    int n = packed_named(p), padding = packed_padding(p);
+    for (int i = 0; i < n; ++i) {
+        int offset = packed_offset(p, i);
+        if (i) *c++ = ',';
+        if (offset < 0) {*c++ = '-'; offset = -offset;}
+        *c++ = '0' + offset;
+    }
+    *c++ = packed_type(p);
+    if (padding) *c++ = '0' + padding;
+    *c = '\0';
+    return c - name;
+}
+
+void expand(packed p, int *offsets, int *length, int *align) {
+    int n = packed_named(p), padding = packed_padding(p);
+    for (int i = 0; i < n; ++i) offsets[i] = packed_offset(p, i);
+    switch (packed_type(p)) {
+    case 'A':  // reflected about the last (central) spoke
+        for (int i = 1; i < n; ++i) offsets[n + i - 1] = -offsets[n - i - 1];
+        *length = 2 * n - 1;
+        break;
+    case 'B':
+        for (int i = 0; i < n; ++i) offsets[n + i] = -offsets[n - i - 1];
+        *length = 2 * n;
+        break;
+    default:
+        *length = n;
+    }
+    for (int i = 0; i < padding; ++i) offsets[(*length)++] = 0;
+    if (align) *align = packed_type(p) == 'C' ? 0 : padding;
+}
+
+// text[size] must be readable (eg '\0') so that a final name can end.
+int parse_names(const char *text, size_t size, packed *p, int max, int *n) {
+    const char *c = text, *end = text + size;
+    *n = 0;
+    while (*n < max) {
+        while (c < end && (*c == '\n' || *c == '\r' || *c == ' ' || *c == '\t')) c++;
+        if (c == end) break;
+        if (parse_name(c, &p[*n], &c) || c > end) return LU_ERR_ARG;
+        (*n)++;
+        while (c < end && *c != '\n') c++;
+    }
+    return LU_OK;
+}
+
+size_t format_names(const packed *p, int n, char *text) {
+    char *c = text;
+    for (int i = 0; i < n; ++i) {
+        c += format_name(p[i], c);
+        *c++ = '\n';
+    }
+    return c - text;
+}
+
+int decode(lulog *dbg, const char *pattern, packed *p, int *offsets, int *length, char *type, int *padding) {
+
+    LU_STATUS
+    packed local;
+    const char *end;
+    PROFILE_BEGIN(t);
+
+    if (!p) p = &local;
+    LU_ASSERT(!parse_name(pattern, p, &end), LU_ERR_ARG, dbg,
+            "Bad pattern %s (offsets, then group A, B or C, then padding)", pattern)
+    LU_ASSERT(!*end, LU_ERR_ARG, dbg, "Unexpected '%s' after pattern %s", end, pattern)
+    if (packed_type(*p) == 'A' && packed_offset(*p, packed_named(*p) - 1)) {
+        luwarn(dbg, "Central offset for group A is non-zero");
+    }
+    expand(*p, offsets, length, padding);
+    if (type) *type = packed_type(*p);
+
+LU_CLEANUP
+    PROFILE_END(t, probe_decode);
+    LU_RETURN
+}
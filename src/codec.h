@@ -0,0 +1,49 @@
+
+#ifndef SPOKES_CODEC_H
+#define SPOKES_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lu/log.h"
+
+// pattern names (eg "2,-3B1") and a packed value that holds the same
+// information in 64 bits, so that patterns can be passed around, stored
+// and compared without allocating.  a name is a comma separated list of
+// offsets (single digits, with '-' to negate), then the group (A, B or
+// C), then an optional digit of padding.  groups A and B are reflected
+// when expanded (A about a central spoke), and padding adds zero offsets.
+
+typedef uint64_t packed;
+
+#define PACKED_MAX_NAMED 10                          // offsets in a name
+#define PACKED_MAX_LENGTH (2 * PACKED_MAX_NAMED + 9)  // after expansion
+#define PACKED_MAX_NAME (3 * PACKED_MAX_NAMED + 3)    // including '\0'
+
+char packed_type(packed p);
+int packed_named(packed p);
+int packed_padding(packed p);
+int packed_offset(packed p, int i);
+int pack_offsets(char type, const int *offsets, int n, int padding, packed *p);
+
+// single names.  these do not log, so return LU_ERR_ARG for a bad name
+// (parse_name() sets end after the name, which may be followed by
+// anything but a digit).
+int parse_name(const char *name, packed *p, const char **end);
+int format_name(packed p, char *name);
+// the offsets for every spoke in the pattern (offsets must hold
+// PACKED_MAX_LENGTH) and the alignment of the other side (the padding
+// for A and B; padding for C only extends the pattern).
+void expand(packed p, int *offsets, int *length, int *align);
+
+// bulk conversion.  parse_names() reads the first word of each line
+// (so reads search output directly) until size bytes or max patterns;
+// format_names() writes one name per line into text, which must hold
+// n * PACKED_MAX_NAME bytes, and returns the bytes written.
+int parse_names(const char *text, size_t size, packed *p, int max, int *n);
+size_t format_names(const packed *p, int n, char *text);
+
+// with logging, for names from users
+int decode(lulog *dbg, const char *pattern, packed *p, int *offsets, int *length, char *type, int *padding);
+
+#endif
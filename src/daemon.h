@@ -0,0 +1,18 @@
+
+#ifndef SPOKES_DAEMON_H
+#define SPOKES_DAEMON_H
+
+// the protocol between spokesd and its clients.  a client sends lines
+//   canon pattern    the name used by search for the same lacing
+//   plot pattern     the lacing as a png (as plot)
+//   stress pattern   the stresses under load (as the stress sweep csv)
+// and, for each, reads a line "status length" followed by length bytes
+// (nothing if status is non-zero).  a connection can carry any number
+// of requests, answered in order.
+
+#define DEFAULT_SOCKET "spokesd.sock"
+#define MAX_REQUEST 256     // including the newline
+#define MAX_PATTERN 64
+#define MAX_PATTERN_FORMAT "63"
+
+#endif
@@ -0,0 +1,166 @@
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lu/status.h"
+#include "lu/log.h"
+#include "lu/dynamic_memory.h"
+
+#include "codec.h"
+#include "spokes.h"
+
+
+// an index of the patterns found by spokes_search(), so that any
+// pattern that laces the same way (the same offsets, after rotation,
+// repetition, or reversal with negation) can be given the name the
+// search would have used.
+
+// each offset is packed into 4 bits, after the length
+#define KEY_BITS 4
+#define KEY_MAX_LENGTH 14
+#define KEY_BIAS 8
+
+typedef struct {
+    uint64_t key;
+    int order;       // position in the search (earlier names win)
+    char *pattern;
+} index_entry;
+
+struct spokes_index {
+    lulog *log;
+    int n;
+    int size;
+    index_entry *entries;
+};
+
+static uint64_t pack(int *offsets, int length, int start, int direction) {
+    uint64_t key = length;
+    for (int i = 0; i < length; ++i) {
+        int offset = offsets[(start + direction * i + 2 * length) % length];
+        key = (key << KEY_BITS) | (direction * offset + KEY_BIAS);
+    }
+    return key;
+}
+
+// the smallest key over all rotations of the shortest repeat and its
+// reversal (negated, so that the lacing is unchanged)
+static int canonical_key(lulog *dbg, int *offsets, int length, uint64_t *key) {
+
+    LU_STATUS
+    int period = length;
+
+    for (int p = 1; p < length; ++p) {
+        if (length % p) continue;
+        int repeats = 1;
+        for (int i = p; i < length && repeats; ++i) repeats = offsets[i] == offsets[i % p];
+        if (repeats) {period = p; break;}
+    }
+    LU_ASSERT(period <= KEY_MAX_LENGTH, LU_ERR_ARG, dbg, "Pattern repeats every %d spokes (max %d)",
+            period, KEY_MAX_LENGTH)
+    for (int i = 0; i < period; ++i) {
+        LU_ASSERT(abs(offsets[i]) < KEY_BIAS, LU_ERR_ARG, dbg, "Offset %d too large", offsets[i])
+    }
+
+    *key = UINT64_MAX;
+    for (int i = 0; i < period; ++i) {
+        uint64_t forwards = pack(offsets, period, i, 1), backwards = pack(offsets, period, i, -1);
+        if (forwards < *key) *key = forwards;
+        if (backwards < *key) *key = backwards;
+    }
+
+    LU_NO_CLEANUP
+}
+
+static int pattern_key(lulog *dbg, const char *pattern, uint64_t *key) {
+    LU_STATUS
+    int offsets[PACKED_MAX_LENGTH], length = 0;
+    LU_CHECK(decode(dbg, pattern, NULL, offsets, &length, NULL, NULL))
+    LU_CHECK(canonical_key(dbg, offsets, length, key))
+    LU_NO_CLEANUP
+}
+
+static int add_entry(void *user, const char *pattern, packed p, int length) {
+
+    LU_STATUS
+    spokes_index *idx = user;
+    lulog *dbg = idx->log;
+    index_entry *e;
+    int offsets[PACKED_MAX_LENGTH];
+
+    if (idx->n == idx->size) {
+        idx->size = idx->size ? 2 * idx->size : 256;
+        LU_ASSERT(idx->entries = realloc(idx->entries, idx->size * sizeof(*idx->entries)), LU_ERR_MEM, dbg,
+                "Cannot grow index")
+    }
+    e = &idx->entries[idx->n];
+    memset(e, 0, sizeof(*e));
+    e->order = idx->n++;
+    LU_ALLOC(dbg, e->pattern, strlen(pattern) + 1)
+    strcpy(e->pattern, pattern);
+    expand(p, offsets, &length, NULL);
+    LU_CHECK(canonical_key(dbg, offsets, length, &e->key))
+
+    LU_NO_CLEANUP
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const index_entry *ea = a, *eb = b;
+    if (ea->key != eb->key) return ea->key < eb->key ? -1 : 1;
+    return ea->order - eb->order;
+}
+
+int spokes_index_alloc(spokes *ctx, spokes_index **idx) {
+
+    LU_STATUS
+    lulog *dbg = ctx->log;
+    int n = 0;
+
+    LU_ALLOC(dbg, *idx, 1)
+    (*idx)->log = dbg;
+    LU_CHECK(spokes_search(ctx, add_entry, *idx))
+    // sort by key, then drop later names for the same lacing
+    qsort((*idx)->entries, (*idx)->n, sizeof(*(*idx)->entries), compare_entries);
+    for (int i = 0; i < (*idx)->n; ++i) {
+        index_entry *e = &(*idx)->entries[i];
+        if (n && (*idx)->entries[n-1].key == e->key) {
+            ludebug(dbg, "%s duplicates %s", e->pattern, (*idx)->entries[n-1].pattern);
+            free(e->pattern);
+        } else {
+            (*idx)->entries[n++] = *e;
+        }
+    }
+    (*idx)->n = n;
+    luinfo(dbg, "Indexed %d patterns", n);
+
+    LU_NO_CLEANUP
+}
+
+int spokes_index_free(spokes_index *idx, int prev_status) {
+    if (idx) {
+        for (int i = 0; i < idx->n; ++i) free(idx->entries[i].pattern);
+        free(idx->entries);
+        free(idx);
+    }
+    return prev_status;
+}
+
+int spokes_canonical(spokes *ctx, spokes_index *idx, const char *pattern, const char **canonical) {
+
+    LU_STATUS
+    lulog *dbg = ctx->log;
+    uint64_t key;
+    int lo = 0, hi = idx->n;
+
+    // keys are unique after spokes_index_alloc()
+    LU_CHECK(pattern_key(dbg, pattern, &key))
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (idx->entries[mid].key < key) lo = mid + 1; else hi = mid;
+    }
+    LU_ASSERT(lo < idx->n && idx->entries[lo].key == key, LU_ERR_ARG, dbg,
+            "No indexed pattern laces like %s", pattern)
+    *canonical = idx->entries[lo].pattern;
+
+    LU_NO_CLEANUP
+}
@@ -0,0 +1,165 @@
+
+#include <math.h>
+
+#include "kernel.h"
+
+
+// scalar reference versions
+
+static void scalar_extension(int n, const double *ax, const double *ay, const double *bx, const double *by,
+        const double *l0, double *dx, double *dy, double *len, double *extn) {
+    for (int i = 0; i < n; ++i) {
+        dx[i] = ax[i] - bx[i];
+        dy[i] = ay[i] - by[i];
+        len[i] = sqrt(dx[i] * dx[i] + dy[i] * dy[i]);
+        extn[i] = len[i] - l0[i];
+    }
+}
+
+static double scalar_energy(int n, double k, const double *extn, const double *inv_l0) {
+    double energy = 0;
+    for (int i = 0; i < n; ++i) energy += extn[i] * extn[i] * inv_l0[i];
+    return 0.5 * k * energy;
+}
+
+static void scalar_force(int n, double k, const double *extn, const double *inv_l0,
+        const double *dx, const double *dy, const double *len, double *fx, double *fy) {
+    for (int i = 0; i < n; ++i) {
+        double t = k * extn[i] * inv_l0[i] / len[i];
+        fx[i] = t * dx[i];
+        fy[i] = t * dy[i];
+    }
+}
+
+// a single spring from b to a; returns extn^2 / l0 and sets the force on a
+// (negated).
+static inline double spring(double k, double dx, double dy, double l0, double inv_l0, double *fx, double *fy) {
+    double len = sqrt(dx * dx + dy * dy), extn = len - l0, t = k * extn * inv_l0 / len;
+    *fx = t * dx;
+    *fy = t * dy;
+    return extn * extn * inv_l0;
+}
+
+// each chord is calculated once, as the chord after node i, and carried
+// forwards as the chord before node i+1.  chord 0 (before node 0) is kept
+// for the end.
+static double scalar_fused(int n, double k_spoke, double k_chord, const double *base, const double *offset,
+        const double *hub_x, const double *hub_y, const double *l_spoke, const double *inv_l_spoke,
+        const double *l_chord, const double *inv_l_chord, double *neg_force) {
+    double spokes = 0, chords = 0;
+    double x = base[0] + offset[0], y = base[1] + offset[1];
+    double bx = base[2*n-2] + offset[2*n-2], by = base[2*n-1] + offset[2*n-1];
+    double fx0, fy0, sfx, sfy;
+    chords += spring(k_chord, x - bx, y - by, l_chord[0], inv_l_chord[0], &fx0, &fy0);
+    double before_fx = fx0, before_fy = fy0;
+    for (int i = 0; i < n; ++i) {
+        double ax = x, ay = y, after_fx = fx0, after_fy = fy0;
+        if (i + 1 < n) {
+            ax = base[2*i+2] + offset[2*i+2];
+            ay = base[2*i+3] + offset[2*i+3];
+            chords += spring(k_chord, ax - x, ay - y, l_chord[i+1], inv_l_chord[i+1], &after_fx, &after_fy);
+        }
+        spokes += spring(k_spoke, x - hub_x[i], y - hub_y[i], l_spoke[i], inv_l_spoke[i], &sfx, &sfy);
+        neg_force[2*i] = sfx + before_fx - after_fx;
+        neg_force[2*i+1] = sfy + before_fy - after_fy;
+        x = ax; y = ay;
+        before_fx = after_fx; before_fy = after_fy;
+    }
+    return 0.5 * (k_spoke * spokes + k_chord * chords);
+}
+
+const kernels scalar_kernels = {"scalar", scalar_extension, scalar_energy, scalar_force, scalar_fused};
+
+
+// vectorised versions (avx if the compiler targets it, otherwise sse2).
+// the scalar versions handle any remainder.
+
+#if defined(__AVX__)
+
+#include <immintrin.h>
+#define SIMD_NAME "avx"
+#define WIDTH 4
+typedef __m256d vec;
+#define LOAD _mm256_loadu_pd
+#define STORE _mm256_storeu_pd
+#define SET1 _mm256_set1_pd
+#define ZERO _mm256_setzero_pd
+#define ADD _mm256_add_pd
+#define SUB _mm256_sub_pd
+#define MUL _mm256_mul_pd
+#define DIV _mm256_div_pd
+#define SQRT _mm256_sqrt_pd
+
+#elif defined(__SSE2__)
+
+#include <emmintrin.h>
+#define SIMD_NAME "sse2"
+#define WIDTH 2
+typedef __m128d vec;
+#define LOAD _mm_loadu_pd
+#define STORE _mm_storeu_pd
+#define SET1 _mm_set1_pd
+#define ZERO _mm_setzero_pd
+#define ADD _mm_add_pd
+#define SUB _mm_sub_pd
+#define MUL _mm_mul_pd
+#define DIV _mm_div_pd
+#define SQRT _mm_sqrt_pd
+
+#endif
+
+#ifdef WIDTH
+
+static double hsum(vec v) {
+    double t[WIDTH], sum = 0;
+    STORE(t, v);
+    for (int i = 0; i < WIDTH; ++i) sum += t[i];
+    return sum;
+}
+
+static void simd_extension(int n, const double *ax, const double *ay, const double *bx, const double *by,
+        const double *l0, double *dx, double *dy, double *len, double *extn) {
+    int i = 0;
+    for (; i + WIDTH <= n; i += WIDTH) {
+        vec x = SUB(LOAD(ax + i), LOAD(bx + i));
+        vec y = SUB(LOAD(ay + i), LOAD(by + i));
+        vec l = SQRT(ADD(MUL(x, x), MUL(y, y)));
+        STORE(dx + i, x);
+        STORE(dy + i, y);
+        STORE(len + i, l);
+        STORE(extn + i, SUB(l, LOAD(l0 + i)));
+    }
+    scalar_extension(n - i, ax + i, ay + i, bx + i, by + i, l0 + i, dx + i, dy + i, len + i, extn + i);
+}
+
+static double simd_energy(int n, double k, const double *extn, const double *inv_l0) {
+    int i = 0;
+    vec sum = ZERO();
+    for (; i + WIDTH <= n; i += WIDTH) {
+        vec e = LOAD(extn + i);
+        sum = ADD(sum, MUL(MUL(e, e), LOAD(inv_l0 + i)));
+    }
+    return 0.5 * k * hsum(sum) + scalar_energy(n - i, k, extn + i, inv_l0 + i);
+}
+
+static void simd_force(int n, double k, const double *extn, const double *inv_l0,
+        const double *dx, const double *dy, const double *len, double *fx, double *fy) {
+    int i = 0;
+    vec kk = SET1(k);
+    for (; i + WIDTH <= n; i += WIDTH) {
+        vec t = DIV(MUL(MUL(kk, LOAD(extn + i)), LOAD(inv_l0 + i)), LOAD(len + i));
+        STORE(fx + i, MUL(t, LOAD(dx + i)));
+        STORE(fy + i, MUL(t, LOAD(dy + i)));
+    }
+    scalar_force(n - i, k, extn + i, inv_l0 + i, dx + i, dy + i, len + i, fx + i, fy + i);
+}
+
+// the fused pass carries each chord from one node to the next, so stays
+// scalar.
+const kernels simd_kernels = {SIMD_NAME, simd_extension, simd_energy, simd_force, scalar_fused};
+
+#else
+
+const kernels simd_kernels = {"scalar", scalar_extension, scalar_energy, scalar_force, scalar_fused};
+
+#endif
@@ -0,0 +1,31 @@
+
+#ifndef SPOKES_KERNEL_H
+#define SPOKES_KERNEL_H
+
+// kernels for the inner loop of the stress calculation.  all arrays are
+// separate x and y components (structure of arrays) so that they can be
+// vectorised.  springs (spokes or chords) run from b to a and have
+// unloaded length l0.
+
+typedef struct {
+    const char *name;
+    // d = a - b; len = |d|; extn = len - l0
+    void (*extension)(int n, const double *ax, const double *ay, const double *bx, const double *by,
+            const double *l0, double *dx, double *dy, double *len, double *extn);
+    // sum of k extn^2 / 2 l0 (given 1 / l0, to avoid division)
+    double (*energy)(int n, double k, const double *extn, const double *inv_l0);
+    // f = (k extn / l0) d / len (the force on a, negated)
+    void (*force)(int n, double k, const double *extn, const double *inv_l0,
+            const double *dx, const double *dy, const double *len, double *fx, double *fy);
+    // all of the above in a single pass, for rim = base + offset (both
+    // interleaved xy, like neg_force), with chord i from i-1 to i.  returns
+    // the energy and writes neg_force, with no intermediate arrays.
+    double (*fused)(int n, double k_spoke, double k_chord, const double *base, const double *offset,
+            const double *hub_x, const double *hub_y, const double *l_spoke, const double *inv_l_spoke,
+            const double *l_chord, const double *inv_l_chord, double *neg_force);
+} kernels;
+
+extern const kernels scalar_kernels;
+extern const kernels simd_kernels;
+
+#endif
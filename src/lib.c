@@ -9,127 +9,153 @@
 #include "lu/files.h"
 #include "lu/dynamic_memory.h"
 
+#include "codec.h"
 #include "lib.h"
+#include "profile.h"
 
 
-void draw_circle(cairo_t *cr, float r) {
-    cairo_move_to(cr, r, 0);
-    cairo_arc(cr, 0, 0, r, 0, 2*M_PI);
-    cairo_stroke(cr);
+static void pen_added(pen *p) {
+    if (p->batch && ++p->pending >= p->batch) pen_stroke(p);
 }
 
-void draw_line(cairo_t *cr, float x0, float y0, float x1, float y1) {
-    cairo_move_to(cr, x0, y0);
-    cairo_line_to(cr, x1, y1);
-    cairo_stroke(cr);
+void pen_line(pen *p, float x0, float y0, float x1, float y1) {
+    cairo_move_to(p->cr, x0, y0);
+    cairo_line_to(p->cr, x1, y1);
+    pen_added(p);
 }
 
-static int unpack_generic(lulog *dbg, const char *pattern, int **offsets, int *length, const char stop, int *padding) {
-
-    LU_STATUS
-
-    const char *p = pattern;
-    int sign = 1;
-
-    while (*p != stop) {
-        if (*p == ',') sign = 1;
-        else if (*p == '-') sign = -sign;
-        else if (*p >= '0' && *p <= '9'){
-            int offset = *p - '0';
-            if (!(*offsets = realloc(*offsets, (1 + *length) * sizeof(**offsets)))) return LU_ERR_MEM;
-            (*offsets)[*length] = sign * offset;
-            (*length)++;
-            sign = 1;
-        } else {
-            luerror(dbg, "Bad character '%c'", *p);
-            status = LU_ERR;
-            goto exit;
-        }
-        p++;
-    }
-    p++;   // drop stop character
-    if (*p) {
-        *padding = *p - '0';
-    } else {
-        *padding = 0;
-    }
-
-    LU_NO_CLEANUP
+void pen_circle(pen *p, float r) {
+    cairo_move_to(p->cr, r, 0);
+    cairo_arc(p->cr, 0, 0, r, 0, 2*M_PI);
+    pen_added(p);
 }
 
-static int apply_padding(int **offsets, int *length, int padding) {
+// call before changing colour or width
+void pen_stroke(pen *p) {
+    cairo_stroke(p->cr);
+    p->pending = 0;
+}
 
-    LU_STATUS
+static void draw_spoke(pen *p, int hub, int offset, float r_hub, float r_rim, int holes) {
+    float fudge = -M_PI / 2;  // rotate so red is in a nice place
+    float t_hub = 2 * M_PI * hub / holes + fudge;
+    float t_rim = 2 * M_PI * (hub + 2 * offset) / holes + fudge;
+    pen_line(p, r_hub * cos(t_hub), r_hub * sin(t_hub), r_rim * cos(t_rim), r_rim * sin(t_rim));
+}
 
-    if (padding) {
-        if (!(*offsets = realloc(*offsets, (padding + *length) * sizeof(**offsets)))) return LU_ERR_MEM;
-        for (int i = 0; i < padding; ++i) (*offsets)[*length + i] = 0;
-        *length = padding + *length;
+static void draw_pattern(pen *p, int *offsets, int length, float r_hub, float r_rim, int holes, int start, int direction) {
+    for (int i = 0; i < length; ++i) {
+        draw_spoke(p, start + 2 * i * direction, offsets[i] * direction, r_hub, r_rim, holes);
     }
-
-    LU_NO_CLEANUP
 }
 
-static int unpack_c(lulog *dbg, const char *pattern, int **offsets, int *length) {
+const lacing_style lacing_default = {0.085, 0.9, 0.03, 0.5, 0.015, 0.5, 0.7, 1};
 
-    LU_STATUS
-    int padding;
+// draw onto an existing surface (so that it can be reused), which sets
+// the size.  batch is as for pen (normally lacing_default.batch).
+void draw_lacing_surface(cairo_surface_t *surface, int *offsets, int length, int holes, int align, int batch) {
 
-    LU_CHECK(unpack_generic(dbg, pattern, offsets, length, 'C', &padding))
-    LU_CHECK(apply_padding(offsets, length, padding))
+    const lacing_style *s = &lacing_default;
+    float r_hub = s->r_hub, r_rim = s->r_rim, wheel_width = s->wheel_width, wheel_grey = s->wheel_grey;
+    float spoke_width = s->spoke_width, red = s->red, spoke_grey = s->spoke_grey;
+    int nx = cairo_image_surface_get_width(surface), ny = cairo_image_surface_get_height(surface);
+    PROFILE_BEGIN(t);
 
-    LU_NO_CLEANUP
-}
+    cairo_t *cr = cairo_create(surface);
+    pen p = {cr, batch, 0};
 
-static int unpack_b(lulog *dbg, const char *pattern, int **offsets, int *length, int *padding) {
+    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+    cairo_paint(cr);
 
-    LU_STATUS
+    // centre at (0,0) with corner at (1,1)
+    cairo_translate(cr, nx/2, ny/2);
+    cairo_scale(cr, nx/2, ny/2);
 
-    LU_CHECK(unpack_generic(dbg, pattern, offsets, length, 'B', padding))
+    cairo_set_line_width(cr, wheel_width);
+    cairo_set_source_rgb(cr, wheel_grey, wheel_grey, wheel_grey);
+    pen_circle(&p, r_hub);
+    pen_circle(&p, r_rim);
+    pen_stroke(&p);
 
-    if (!(*offsets = realloc(*offsets, (2 * *length) * sizeof(**offsets)))) return LU_ERR_MEM;
-    for (int i = 0; i < *length; ++i) (*offsets)[*length + i] = -(*offsets)[*length - i - 1];
-    *length = 2 * *length;
-
-    LU_CHECK(apply_padding(offsets, length, *padding))
-
-    LU_NO_CLEANUP
+    cairo_set_line_width(cr, spoke_width);
+    cairo_set_source_rgb(cr, spoke_grey, spoke_grey, spoke_grey);
+    for (int i = 0; i < holes / (2 * length); ++i) {
+        draw_pattern(&p, offsets, length, r_hub, r_rim, holes, 2 * i * length - 1 - 2 * align, -1);
+    }
+    pen_stroke(&p);
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    for (int i = 1; i < holes / (2 * length); ++i) {
+        draw_pattern(&p, offsets, length, r_hub, r_rim, holes, 2 * i * length, 1);
+    }
+    pen_stroke(&p);
+    cairo_set_source_rgb(cr, red, 0, 0);
+    draw_pattern(&p, offsets, length, r_hub, r_rim, holes, 0, 1);
+    pen_stroke(&p);
+
+    cairo_destroy(cr);
+    cairo_surface_flush(surface);
+    PROFILE_END(t, probe_draw);
 }
 
-static int unpack_a(lulog *dbg, const char *pattern, int **offsets, int *length, int *padding) {
+// fnv-1a
+uint64_t hash_bytes(uint64_t h, const void *data, size_t n) {
+    const unsigned char *c = data;
+    for (size_t i = 0; i < n; ++i) h = (h ^ c[i]) * 1099511628211ULL;
+    return h;
+}
 
-    LU_STATUS
+// everything that changes the image from draw_lacing()
+uint64_t lacing_key(int *offsets, int length, int holes, int nx, int ny, int align) {
+    uint64_t h = 14695981039346656037ULL;
+    h = hash_bytes(h, &length, sizeof(length));
+    h = hash_bytes(h, offsets, length * sizeof(*offsets));
+    h = hash_bytes(h, &align, sizeof(align));
+    h = hash_bytes(h, &holes, sizeof(holes));
+    h = hash_bytes(h, &nx, sizeof(nx));
+    h = hash_bytes(h, &ny, sizeof(ny));
+    h = hash_bytes(h, &lacing_default, sizeof(lacing_default));
+    return h;
+}
 
-    LU_CHECK(unpack_generic(dbg, pattern, offsets, length, 'A', padding))
+int draw_lacing(int *offsets, int length, int holes, int nx, int ny, int align, const char *path) {
 
-    if ((*offsets)[*length-1]) luwarn(dbg, "Central offset for group A is non-zero");
-    if (!(*offsets = realloc(*offsets, (2 * *length - 1) * sizeof(**offsets)))) return LU_ERR_MEM;
-    for (int i = 1; i < *length; ++i) (*offsets)[*length + i - 1] = -(*offsets)[*length - i - 1];
-    *length = 2 * *length - 1;
+    LU_STATUS;
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, nx, ny);
+    draw_lacing_surface(surface, offsets, length, holes, align, lacing_default.batch);
+    PROFILE_BEGIN(t);
+    status = cairo_surface_write_to_png(surface, path) == CAIRO_STATUS_SUCCESS ? LU_OK : LU_ERR_IO;
+    PROFILE_END(t, probe_png);
 
-    LU_CHECK(apply_padding(offsets, length, *padding))
+LU_CLEANUP
+    cairo_surface_destroy(surface);
+    LU_RETURN
+}
 
-    LU_NO_CLEANUP
+int plot_size(lulog *dbg, char type, int *nx, int *ny) {
+    switch(type) {
+    case 'A':
+    case 'B':
+        *nx = *ny = 200;
+        return LU_OK;
+    case 'C':
+        *nx = *ny = 100;
+        return LU_OK;
+    default:
+        luerror(dbg, "Unexpected type %c", type);
+        return LU_ERR;
+    }
 }
 
+// as decode(), but with the offsets in a new array (for callers that
+// keep them)
 int unpack(lulog *dbg, const char *pattern, int **offsets, int *length, char *type, int *padding) {
 
     LU_STATUS
+    int expanded[PACKED_MAX_LENGTH];
 
-    if (strchr(pattern, 'A')) {
-        LU_CHECK(unpack_a(dbg, pattern, offsets, length, padding));
-        if (type) *type = 'A';
-    } else if (strchr(pattern, 'B')) {
-        LU_CHECK(unpack_b(dbg, pattern, offsets, length, padding));
-        if (type) *type = 'B';
-    } else if (strchr(pattern, 'C')) {
-        LU_CHECK(unpack_c(dbg, pattern, offsets, length));
-        if (type) *type = 'C';
-        *padding = 0;
-    } else {
-        luerror(dbg, "Did not find group type (A, B, C) in %s", pattern);
-        status = LU_ERR_ARG;
-    }
+    LU_CHECK(decode(dbg, pattern, NULL, expanded, length, type, padding))
+    LU_ALLOC(dbg, *offsets, *length)
+    for (int i = 0; i < *length; ++i) (*offsets)[i] = expanded[i];
 
     LU_NO_CLEANUP
 }
@@ -2,12 +2,48 @@
 #ifndef SPOKES_LIB_H
 #define SPOKES_LIB_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "cairo/cairo.h"
 
 #include "lu/log.h"
 
-void draw_circle(cairo_t *cr, float r);
-void draw_line(cairo_t *cr, float x0, float y0, float x1, float y1);
+// lines and circles are added to the current path and stroked together,
+// once per colour and width, since cairo has a large fixed cost for each
+// stroke.  a batch of 1 strokes every segment as it is added (as before,
+// for comparison in benchmarks).  where segments of one colour cross or
+// meet, a batched stroke covers them once, so the antialiased joins are
+// a little lighter.
+typedef struct {
+    cairo_t *cr;
+    int batch;      // segments per stroke, or 0 for all
+    int pending;    // segments in the current path
+} pen;
+
+void pen_line(pen *p, float x0, float y0, float x1, float y1);
+void pen_circle(pen *p, float r);
+void pen_stroke(pen *p);
+
+// the constants for lacing plots (in units of half the image)
+typedef struct {
+    float r_hub;
+    float r_rim;
+    float wheel_width;
+    float wheel_grey;
+    float spoke_width;
+    float red;
+    float spoke_grey;
+    int batch;          // as for pen; 1 matches the images in img/
+} lacing_style;
+
+extern const lacing_style lacing_default;
+
+void draw_lacing_surface(cairo_surface_t *surface, int *offsets, int length, int holes, int align, int batch);
+int draw_lacing(int *offsets, int length, int holes, int nx, int ny, int align, const char *path);
+uint64_t hash_bytes(uint64_t h, const void *data, size_t n);
+uint64_t lacing_key(int *offsets, int length, int holes, int nx, int ny, int align);
+int plot_size(lulog *dbg, char type, int *nx, int *ny);
 int unpack(lulog *dbg, const char *pattern, int **offsets, int *length, char *type, int *padding);
 int dump_pattern(lulog *dbg, int *offsets, int length);
 int rim_size(lulog *dbg, int length, int *holes);
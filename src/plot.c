@@ -1,130 +1,212 @@
 
-#include <stdint.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
-#include <math.h>
-#include <cairo/cairo.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "lu/status.h"
 #include "lu/log.h"
 #include "lu/files.h"
-#include "lu/dynamic_memory.h"
+#include "lu/strings.h"
 
+#include "codec.h"
 #include "lib.h"
+#include "wheel.h"
+#include "trace.h"
+#include "spokes.h"
+#include "profile.h"
 
 
 lulog *dbg = NULL;
 
-void draw_spoke(cairo_t *cr, int hub, int offset, float r_hub, float r_rim, int holes) {
-    float fudge = -M_PI / 2;  // rotate so red is in a nice place
-    float t_hub = 2 * M_PI * hub / holes + fudge;
-    float t_rim = 2 * M_PI * (hub + 2 * offset) / holes + fudge;
-    cairo_move_to(cr, r_hub * cos(t_hub), r_hub * sin(t_hub));
-    cairo_line_to(cr, r_rim * cos(t_rim), r_rim * sin(t_rim));
-    cairo_stroke(cr);
-}
+#define N_BENCH 1000
 
-void draw_pattern(cairo_t *cr, int *offsets, int length, float r_hub, float r_rim, int holes, int start, int direction) {
-    for (int i = 0; i < length; ++i) {
-        draw_spoke(cr, start + 2 * i * direction, offsets[i] * direction, r_hub, r_rim, holes);
-    }
-}
+// a run over many patterns.  with a cache, images are kept by the hash
+// of everything that changes the image (lacing_key()), so patterns that
+// were drawn before (under any name, in any directory) are only copied.
+typedef struct {
+    const char *dir;       // for the images
+    const char *cache;     // images by key (optional)
+    int n_hit;
+    int n_drawn;
+} batch;
 
-int draw(int *offsets, int length, int holes, int nx, int ny, int align, const char *path) {
+static int copy_file(const char *from, const char *to) {
 
-    LU_STATUS;
-    float r_hub = 0.085, r_rim = 0.9, wheel_width = 0.03, wheel_grey = 0.5;
-    float spoke_width = 0.015, red = 0.5, spoke_grey = 0.7;
-
-    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, nx, ny);
-    cairo_t *cr = cairo_create(surface);
+    LU_STATUS
+    FILE *in = NULL, *out = NULL;
+    char buffer[4096];
+    size_t n;
+
+    LU_CHECK(lufle_open(dbg, from, "rb", &in))
+    LU_CHECK(lufle_open(dbg, to, "wb", &out))
+    while ((n = fread(buffer, 1, sizeof(buffer), in))) {
+        LU_ASSERT(fwrite(buffer, 1, n, out) == n, LU_ERR_IO, dbg, "Cannot write %s", to)
+    }
 
-    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
-    cairo_paint(cr);
+LU_CLEANUP
+    if (in) fclose(in);
+    if (out && fclose(out) && !status) status = LU_ERR_IO;
+    LU_RETURN
+}
 
-    // centre at (0,0) with corner at (1,1)
-    cairo_translate(cr, nx/2, ny/2);
-    cairo_scale(cr, nx/2, ny/2);
+int plot(batch *b, const char *pattern) {
 
-    cairo_set_line_width(cr, wheel_width);
-    cairo_set_source_rgb(cr, wheel_grey, wheel_grey, wheel_grey);
-    draw_circle(cr, r_hub);
-    draw_circle(cr, r_rim);
+    LU_STATUS;
+    int offsets[PACKED_MAX_LENGTH], length = 0, holes = 0, nx = 0, ny = 0, padding;
+    char type, *name = NULL;
+    lustr path = {0}, cached = {0}, tmp = {0};
+    int fd, created = 0;
 
-    cairo_set_line_width(cr, spoke_width);
-    cairo_set_source_rgb(cr, spoke_grey, spoke_grey, spoke_grey);
-    for (int i = 0; i < holes / (2 * length); ++i) {
-        draw_pattern(cr, offsets, length, r_hub, r_rim, holes, 2 * i * length - 1 - 2 * align, -1);
-    }
-    cairo_set_source_rgb(cr, 0, 0, 0);
-    for (int i = 1; i < holes / (2 * length); ++i) {
-        draw_pattern(cr, offsets, length, r_hub, r_rim, holes, 2 * i * length, 1);
+    luinfo(dbg, "Pattern '%s'", pattern);
+    LU_CHECK(decode(dbg, pattern, NULL, offsets, &length, &type, &padding))
+    LU_CHECK(dump_pattern(dbg, offsets, length))
+    LU_CHECK(rim_size(dbg, length, &holes))
+    LU_CHECK(plot_size(dbg, type, &nx, &ny))
+    LU_CHECK(make_path(dbg, pattern, &name))
+    LU_CHECK(lustr_sprintf(dbg, &path, "%s/%s", b->dir, name))
+    if (b->cache) {
+        LU_CHECK(lustr_sprintf(dbg, &cached, "%s/%016llx.png", b->cache,
+                (unsigned long long)lacing_key(offsets, length, holes, nx, ny, padding)))
+        if (lufle_exists(dbg, cached.c)) {
+            ludebug(dbg, "Cached as %s", cached.c);
+            b->n_hit++;
+        } else {
+            // drawn beside the entry and renamed, so that an interrupted
+            // or failed write is never taken for a cached image
+            LU_CHECK(lustr_sprintf(dbg, &tmp, "%s.XXXXXX", cached.c))
+            LU_ASSERT((fd = mkstemp(tmp.c)) >= 0, LU_ERR_IO, dbg, "Cannot create %s", tmp.c)
+            close(fd);
+            created = 1;
+            LU_ASSERT(!draw_lacing(offsets, length, holes, nx, ny, padding, tmp.c), LU_ERR_IO, dbg,
+                    "Cannot write %s", tmp.c)
+            LU_ASSERT(!rename(tmp.c, cached.c), LU_ERR_IO, dbg, "Cannot rename %s to %s", tmp.c, cached.c)
+            created = 0;
+            b->n_drawn++;
+        }
+        LU_CHECK(copy_file(cached.c, path.c))
+    } else {
+        LU_ASSERT(!draw_lacing(offsets, length, holes, nx, ny, padding, path.c), LU_ERR_IO, dbg,
+                "Cannot write %s", path.c)
+        b->n_drawn++;
     }
-    cairo_set_source_rgb(cr, red, 0, 0);
-    draw_pattern(cr, offsets, length, r_hub, r_rim, holes, 0, 1);
-
-    cairo_surface_write_to_png(surface, path);
 
 LU_CLEANUP
-    cairo_destroy(cr);
-    cairo_surface_destroy(surface);
+    if (created) unlink(tmp.c);
+    status = lustr_free(&tmp, status);
+    free(name);
+    status = lustr_free(&path, status);
+    status = lustr_free(&cached, status);
     LU_RETURN
 }
 
-int plot_size(char type, int *nx, int *ny) {
-    switch(type) {
-    case 'A':
-    case 'B':
-        *nx = *ny = 200;
-        return LU_OK;
-    case 'C':
-        *nx = *ny = 100;
-        return LU_OK;
-    default:
-        luerror(dbg, "Unexpected type %c", type);
-        return LU_ERR;
-    }
-}
-
-int plot(const char *pattern) {
-
-    LU_STATUS;
-    int *offsets = NULL, length = 0, holes = 0, nx = 0, ny = 0, padding;
-    char *path = NULL, type;
+// images per second for the lacing and the (untrued) wheel, stroking
+// each segment as it is added and then once per colour.
+int bench(const char *pattern) {
 
-    luinfo(dbg, "Pattern '%s'", pattern);
-    LU_CHECK(unpack(dbg, pattern, &offsets, &length, &type, &padding));
-    LU_CHECK(dump_pattern(dbg, offsets, length));
-    LU_CHECK(rim_size(dbg, length, &holes));
-    LU_CHECK(make_path(dbg, pattern, &path));
-    LU_CHECK(plot_size(type, &nx, &ny));
-    LU_CHECK(draw(offsets, length, holes, nx, ny, padding, path));
+    LU_STATUS
+    spokes *ctx = NULL;
+    wheel *w = NULL;
+    cairo_surface_t *lacing = NULL, *image = NULL;
+    cairo_t *cr = NULL;
+    int offsets[PACKED_MAX_LENGTH], length = 0, holes = 0, nx = 0, ny = 0, padding;
+    char type;
+    struct timespec start;
+
+    LU_CHECK(spokes_alloc(dbg, 0, &ctx))
+    LU_CHECK(decode(dbg, pattern, NULL, offsets, &length, &type, &padding))
+    LU_CHECK(rim_size(dbg, length, &holes))
+    LU_CHECK(plot_size(dbg, type, &nx, &ny))
+    lacing = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, nx, ny);
+    LU_ASSERT(cairo_surface_status(lacing) == CAIRO_STATUS_SUCCESS, LU_ERR_MEM, dbg,
+            "Cannot create %dx%d surface", nx, ny)
+    LU_CHECK(spokes_lace(ctx, pattern, &w))
+    open_plot(w, 500, 500, w->r_rim / 100, &cr, &image);
+    LU_ASSERT(cairo_surface_status(image) == CAIRO_STATUS_SUCCESS, LU_ERR_MEM, dbg, "Cannot create surface")
+
+    for (int batch = 1; batch >= 0; --batch) {
+        const char *name = batch ? "each segment" : "batched";
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < N_BENCH; ++i) draw_lacing_surface(lacing, offsets, length, holes, padding, batch);
+        double t_lacing = elapsed(&start);
+        pen p = {cr, batch, 0};
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < N_BENCH; ++i) {
+            cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+            cairo_paint(cr);
+            cairo_set_source_rgb(cr, 0, 0, 0);
+            draw_wheel(&p, w);
+        }
+        cairo_surface_flush(image);
+        double t_wheel = elapsed(&start);
+        luinfo(dbg, "Lacing %dx%d, %s: %.0f images/s", nx, ny, name, N_BENCH / t_lacing);
+        luinfo(dbg, "Wheel 500x500, %s: %.0f images/s", name, N_BENCH / t_wheel);
+    }
 
 LU_CLEANUP
-    free(path);
-    free(offsets);
+    if (cr) cairo_destroy(cr);
+    if (image) cairo_surface_destroy(image);
+    if (lacing) cairo_surface_destroy(lacing);
+    free_wheel(w);
+    status = spokes_free(ctx, status);
     LU_RETURN
 }
 
 void usage(const char *progname) {
-    luinfo(dbg, "Plot the given spoke pattern");
-    luinfo(dbg, "%s -h        display this message", progname);
-    luinfo(dbg, "%s pattern   plot pattern to pattern.png", progname);
+    luinfo(dbg, "Plot the given spoke patterns");
+    luinfo(dbg, "%s -h           display this message", progname);
+    luinfo(dbg, "%s pattern..    plot each pattern to pattern.png", progname);
     luinfo(dbg, "(file name has commas removed)", progname);
+    luinfo(dbg, "%s -b pattern   benchmark drawing, stroking each segment and batched", progname);
+    luinfo(dbg, "options:");
+    luinfo(dbg, "  -d dir        write images to dir (default .)");
+    luinfo(dbg, "  -c dir        cache images in dir (only new or changed plots are drawn)");
+    luinfo(dbg, "  --profile file.json  also write timings");
 }
 
 // error handling is for lulib routines; don't bother elsewhere.
 int main(int argc, char** argv) {
 
     LU_STATUS
+    int c, help = 0, benchmark = 0;
+    const char *profile = NULL;
+    batch b = {"."};
+
     lulog_mkstderr(&dbg, lulog_level_debug);
-    if (argc != 2 || !strcmp("-h", argv[1])) {
+    LU_CHECK(profile_args(dbg, &argc, argv, &profile))
+    while ((c = getopt(argc, argv, "hbc:d:")) != -1) {
+        switch (c) {
+        case 'b':
+            benchmark = 1;
+            break;
+        case 'c':
+            b.cache = optarg;
+            break;
+        case 'd':
+            b.dir = optarg;
+            break;
+        default:
+            help = 1;
+        }
+    }
+    if (help || optind == argc || (benchmark && optind != argc - 1)) {
         usage(argv[0]);
+    } else if (benchmark) {
+        LU_CHECK(bench(argv[optind]))
     } else {
-        LU_CHECK(plot(argv[1]));
+        if (b.cache) {
+            LU_ASSERT(!mkdir(b.cache, 0755) || errno == EEXIST, LU_ERR_IO, dbg,
+                    "Cannot create cache %s", b.cache)
+        }
+        for (int i = optind; i < argc; ++i) LU_CHECK(plot(&b, argv[i]))
+        luinfo(dbg, "%d patterns: %d cached, %d drawn", b.n_hit + b.n_drawn, b.n_hit, b.n_drawn);
     }
 
 LU_CLEANUP
+    status = profile_write(dbg, profile, status);
     if (dbg) status = dbg->free(&dbg, status);
     return status;
 }
@@ -0,0 +1,113 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "lu/status.h"
+#include "lu/log.h"
+#include "lu/files.h"
+
+#include "trace.h"
+#include "profile.h"
+
+
+const char *probe_names[n_probe] = {"decode", "lace", "search_a", "search_b", "search_c", "candidate",
+        "sieve_set", "check_lacing", "relax", "true", "deform", "draw", "png"};
+
+volatile int profiling = 0;
+
+// one per thread, allocated on first use and kept (even after the
+// thread exits) until written
+typedef struct totals {
+    long calls[n_probe];
+    double seconds[n_probe];
+    long count[n_probe];
+    struct totals *next;
+} totals;
+
+static __thread totals *local = NULL;
+static totals *all = NULL;
+static pthread_mutex_t all_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// NULL if out of memory (the probe is lost)
+static totals *thread_totals(void) {
+    if (!local && (local = calloc(1, sizeof(*local)))) {
+        pthread_mutex_lock(&all_lock);
+        local->next = all;
+        all = local;
+        pthread_mutex_unlock(&all_lock);
+    }
+    return local;
+}
+
+void profile_time(probe p, struct timespec *start) {
+    totals *t = thread_totals();
+    if (t) {
+        t->calls[p]++;
+        t->seconds[p] += elapsed(start);
+    }
+}
+
+void profile_count(probe p, long n) {
+    totals *t = thread_totals();
+    if (t) t->count[p] += n;
+}
+
+void profile_start(void) {
+    profiling = 1;
+}
+
+int profile_args(lulog *dbg, int *argc, char **argv, const char **path) {
+    LU_STATUS
+    *path = NULL;
+    for (int i = 1; i < *argc; ++i) {
+        if (!strcmp(argv[i], "--profile")) {
+            LU_ASSERT(i + 1 < *argc, LU_ERR_ARG, dbg, "--profile needs a file")
+            *path = argv[i+1];
+            for (int j = i + 2; j <= *argc; ++j) argv[j-2] = argv[j];  // including the final NULL
+            *argc -= 2;
+            profile_start();
+            break;
+        }
+    }
+    LU_NO_CLEANUP
+}
+
+int profile_write(lulog *dbg, const char *path, int prev_status) {
+
+    LU_STATUS
+    FILE *out = NULL;
+    totals sum = {{0}};
+    int n_threads = 0;
+
+    if (!path) return prev_status;
+    profiling = 0;
+    pthread_mutex_lock(&all_lock);
+    while (all) {
+        totals *t = all;
+        for (int p = 0; p < n_probe; ++p) {
+            sum.calls[p] += t->calls[p];
+            sum.seconds[p] += t->seconds[p];
+            sum.count[p] += t->count[p];
+        }
+        all = t->next;
+        free(t);
+        n_threads++;
+    }
+    local = NULL;  // others have exited (or are idle)
+    pthread_mutex_unlock(&all_lock);
+
+    LU_CHECK(lufle_open(dbg, path, "w", &out))
+    fprintf(out, "{\n  \"threads\": %d,\n  \"probes\": {", n_threads);
+    for (int p = 0; p < n_probe; ++p) {
+        fprintf(out, "%s\n    \"%s\": {\"calls\": %ld, \"seconds\": %.9f, \"count\": %ld}",
+                p ? "," : "", probe_names[p], sum.calls[p], sum.seconds[p], sum.count[p]);
+    }
+    fprintf(out, "\n  }\n}\n");
+    luinfo(dbg, "Profile written to %s", path);
+
+LU_CLEANUP
+    if (out) fclose(out);
+    return prev_status ? prev_status : status;
+}
@@ -0,0 +1,49 @@
+
+#ifndef SPOKES_PROFILE_H
+#define SPOKES_PROFILE_H
+
+#include <time.h>
+
+#include "lu/log.h"
+
+// where the time goes.  timers (calls and seconds) and counters are
+// kept per thread, without locks, and merged when written.  everything
+// is off until profile_start(), and while off each probe is a test of a
+// single flag (the one piece of process-wide state in the library).
+
+typedef enum {
+    probe_decode,       // pattern names to offsets
+    probe_lace,
+    probe_search_a,
+    probe_search_b,
+    probe_search_c,
+    probe_candidate,    // patterns checked against the sieve
+    probe_sieve_set,    // bits set in the sieve
+    probe_check_lacing,
+    probe_relax,
+    probe_true,
+    probe_deform,
+    probe_draw,         // cairo drawing
+    probe_png,          // png encoding and writing
+    n_probe
+} probe;
+
+extern const char *probe_names[n_probe];
+
+extern volatile int profiling;
+
+#define PROFILE_BEGIN(t) struct timespec t; if (profiling) clock_gettime(CLOCK_MONOTONIC, &t)
+#define PROFILE_END(t, p) do {if (profiling) profile_time(p, &t);} while (0)
+#define PROFILE_COUNT(p, n) do {if (profiling) profile_count(p, n);} while (0)
+
+void profile_time(probe p, struct timespec *start);
+void profile_count(probe p, long n);
+
+// remove "--profile path" from the arguments (before any other parsing)
+// and start profiling if it was given.
+int profile_args(lulog *dbg, int *argc, char **argv, const char **path);
+void profile_start(void);
+// merge all threads and write json to path (if not NULL)
+int profile_write(lulog *dbg, const char *path, int prev_status);
+
+#endif
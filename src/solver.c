@@ -0,0 +1,2165 @@
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "gsl/gsl_multimin.h"
+#include "gsl/gsl_vector.h"
+#include "gsl/gsl_min.h"
+#include "gsl/gsl_matrix.h"
+#include "gsl/gsl_linalg.h"
+#include "gsl/gsl_errno.h"
+#include "gsl/gsl_blas.h"
+#include "gsl/gsl_complex_math.h"
+
+#include "lu/status.h"
+#include "lu/log.h"
+#include "lu/strings.h"
+#include "lu/dynamic_memory.h"
+
+#include "codec.h"
+#include "lib.h"
+#include "profile.h"
+#include "wheel.h"
+#include "kernel.h"
+#include "trace.h"
+#include "solver.h"
+#include "spokes.h"
+
+
+#define N_DEFORM 1
+#define MAX_SIZE 1e-8
+#define STALL_ENERGY 1e-10
+#define STALL_GRADIENT 0.99
+#define MIN_MODES 2
+#define LEVEL_SIZE 1e-6
+
+const char *method_names[n_method] = {"sd", "cg", "bfgs2", "newton", "nm", "cell", "gs", "ml"};
+const char *param_names[n_param] = {"r_hub", "r_rim", "tension", "e_spoke", "e_rim"};
+const char *quality_names[n_quality] = {"converged", "unconverged", "budget", "interrupted"};
+
+
+/*
+ * this coded does finite element analysis of wheels using a very simple
+ * physical model (described somewhere in an email or online post by jobst)
+ * where the rim is "hinged" at each spoke hole.
+ *
+ * unfortunately, for two leading two following, that model leads to a
+ * non-physical solution, where the rim folds back on itself.  also, the
+ * code below is extremely slow to converge - perhaps because i don't
+ * know how best to propagate forces around the rim when not in
+ * equilibrium.
+ *
+ * so i am not developing this further.
+ */
+
+
+
+double angle_to_rim(wheel *wheel, int i_hub) {
+    int i_rim = wheel->hub_to_rim[i_hub];
+    xy hub = wheel->hub[i_hub];
+    xy rim = wheel->rim[i_rim];
+    // angle of spoke relative to horizontal
+    double theta = atan2(rim.y - hub.y, rim.x - hub.x);
+    // angle of radius to horizontal
+    double psi = atan2(rim.y, rim.x);
+    // angle of spoke relative to tangent, where 0 = along rim anticlock,
+    // 90 = towards axle, 180 = along rim clock (but in radians...)
+    return M_PI / 2 - psi + theta;
+}
+
+double eval_fourier_coeff(int i, int j, int n, double a) {
+    double shift = a;
+    if (i) {
+        int n_cycles = (i + 1) / 2;  // i = 1,2 -> 1; i = n-1 -> n/2
+        double x = j / (float)n;  // 0-1
+        double y = 2 * M_PI * x * n_cycles;
+        if (i % 2) {
+            // when i = n-1 we are here with n_cycles = n/2
+            // and get 1,-1,1,-1... for j = 0...n-1
+            // eg j = 1, x = 1/n, y = pi
+            shift = a * cos(y);
+        } else {
+            shift = a * sin(y);
+        }
+    }
+//    ludebug(dbg, "Shift %g for coeff %d at rim %d/%d, coeff %g", shift, i, j, n, a);
+    return shift;
+}
+
+// coeff may hold only the lowest modes (see relax_f_multilevel()).
+void fourier_coeff_to_rim(const gsl_vector *coeff, data *d) {
+
+    wheel *w = d->wheel;
+
+    for (int i = 0; i < coeff->size / 2; ++i) {
+        for (int j = 0; j < w->n_holes; ++j) {
+            d->offset[j].x += eval_fourier_coeff(i, j, w->n_holes, gsl_vector_get(coeff, 2*i+X));
+            d->offset[j].y += eval_fourier_coeff(i, j, w->n_holes, gsl_vector_get(coeff, 2*i+Y));
+        }
+    }
+
+    for (int i = 0; i < w->n_holes; ++i) {
+        double dr = d->offset[i].x, dt = d->offset[i].y;
+        double theta = atan2(w->rim[i].y, w->rim[i].x);
+        d->rim[i].x = w->rim[i].x + dr * cos(theta) + dt * sin(theta);
+        d->rim[i].y = w->rim[i].y + dr * sin(theta) - dt * cos(theta);
+    }
+
+}
+
+void xy_coeff_to_rim(const gsl_vector *coeff, data *d) {
+
+    wheel *w = d->wheel;
+
+    for (int i = 0; i < w->n_holes; ++i) {
+        d->offset[i].x = gsl_vector_get(coeff, 2*i+X);
+        d->offset[i].y = gsl_vector_get(coeff, 2*i+Y);
+    }
+
+    for (int i = 0; i < w->n_holes; ++i) {
+        d->rim[i] = add(w->rim[i], d->offset[i]);
+    }
+
+}
+
+
+// copy the parts of the wheel that the kernels need into rim order.
+// must be called whenever l_spoke changes.
+void refresh_data(data *d) {
+    wheel *w = d->wheel;
+    for (int i = 0; i < w->n_holes; ++i) {
+        int i_hub = w->rim_to_hub[i];
+        d->hub_x[i] = w->hub[i_hub].x;
+        d->hub_y[i] = w->hub[i_hub].y;
+        d->l_spoke[i] = w->l_spoke[i_hub];
+        d->l_chord[i] = w->l_chord;
+        d->inv_l_spoke[i] = 1 / d->l_spoke[i];
+        d->inv_l_chord[i] = 1 / d->l_chord[i];
+    }
+}
+
+void calculate_data(const gsl_vector *coeff, data *d) {
+
+    wheel *w = d->wheel;
+    int n = w->n_holes;
+
+    memset(d->offset, 0, n * sizeof(*d->offset));
+    memset(d->rim, 0, n * sizeof(*d->rim));
+
+    d->to_rim(coeff, d);
+
+    for (int i = 0; i < n; ++i) {
+        d->rim_x[i] = d->rim[i].x;
+        d->rim_y[i] = d->rim[i].y;
+    }
+
+    d->k->extension(n, d->rim_x, d->rim_y, d->hub_x, d->hub_y, d->l_spoke,
+            d->spoke_x, d->spoke_y, d->spoke_len, d->spoke_extn);
+//    ludebug(dbg, "Spoke %d extended by %gmm", i, d->spoke_extn[i]);
+
+    // chord i runs from i-1 to i, so do 1...n-1 in bulk and then 0
+    d->k->extension(n - 1, d->rim_x + 1, d->rim_y + 1, d->rim_x, d->rim_y, d->l_chord + 1,
+            d->chord_x + 1, d->chord_y + 1, d->chord_len + 1, d->chord_extn + 1);
+    d->k->extension(1, d->rim_x, d->rim_y, d->rim_x + n - 1, d->rim_y + n - 1, d->l_chord,
+            d->chord_x, d->chord_y, d->chord_len, d->chord_extn);
+//    ludebug(dbg, "Chord %d extended by %gmm", after, d->chord_extn[after]);
+
+    if (d->load) {
+        d->load->end = d->rim[d->load->i_rim];
+    }
+
+}
+
+// potential energy of the load (l->end must be current).
+double load_energy(load *l) {
+    xy disp = sub(l->end, l->start);
+    double s = dot(disp, l->g_norm);
+//    ludebug(dbg, "Load moved by %gmm (%g,%g)", s, disp.x, disp.y);
+    return -s * l->mass * G * 1e-3;  // mm -> m
+}
+
+void add_load_neg_force(load *l, gsl_vector *neg_force) {
+    *gsl_vector_ptr(neg_force, 2*l->i_rim+X) -= l->g_norm.x * l->mass * G * 1e-3;
+    *gsl_vector_ptr(neg_force, 2*l->i_rim+Y) -= l->g_norm.y * l->mass * G * 1e-3;
+}
+
+void calculate_energy(data *d, double *energy) {
+
+    wheel *w = d->wheel;
+    load *l = d->load;
+
+    // 1e-3 since mm
+    *energy = d->k->energy(w->n_holes, 1e-3 * w->e_spoke, d->spoke_extn, d->inv_l_spoke);
+    *energy += d->k->energy(w->n_holes, 1e-3 * w->e_rim, d->chord_extn, d->inv_l_chord);
+    if (l) *energy += load_energy(l);
+}
+
+double sum_force(wheel *w, gsl_vector *neg_force) {
+    double total = 0;
+    for (int i = 0; i < w->n_holes; ++i) {
+        double fx = gsl_vector_get(neg_force, 2*i+X), fy = gsl_vector_get(neg_force, 2*i+Y);
+        total += sqrt(fx * fx + fy * fy);
+    }
+    return total;
+}
+
+// gradient of calculate_energy() with respect to rim position (so only
+// valid as a gradient for xy_coeff_to_rim).
+void calculate_neg_force(data *d, gsl_vector *neg_force) {
+
+    wheel *w = d->wheel;
+    load *l = d->load;
+    int n = w->n_holes;
+
+    d->k->force(n, 1e-3 * w->e_spoke, d->spoke_extn, d->inv_l_spoke, d->spoke_x, d->spoke_y, d->spoke_len,
+            d->spoke_fx, d->spoke_fy);
+    d->k->force(n, 1e-3 * w->e_rim, d->chord_extn, d->inv_l_chord, d->chord_x, d->chord_y, d->chord_len,
+            d->chord_fx, d->chord_fy);
+
+    // each node has its spoke, the chord before (pushing it on) and the
+    // chord after (pulling it back)
+    for (int i = 0; i < n; ++i) {
+        int after = (i + 1) % n;
+        gsl_vector_set(neg_force, 2*i+X, d->spoke_fx[i] + d->chord_fx[i] - d->chord_fx[after]);
+        gsl_vector_set(neg_force, 2*i+Y, d->spoke_fy[i] + d->chord_fy[i] - d->chord_fy[after]);
+    }
+
+    if (l) add_load_neg_force(l, neg_force);
+}
+
+static void add_block(gsl_matrix *h, int i, int j, double sign, double kxx, double kxy, double kyy) {
+    *gsl_matrix_ptr(h, 2*i+X, 2*j+X) += sign * kxx;
+    *gsl_matrix_ptr(h, 2*i+X, 2*j+Y) += sign * kxy;
+    *gsl_matrix_ptr(h, 2*i+Y, 2*j+X) += sign * kxy;
+    *gsl_matrix_ptr(h, 2*i+Y, 2*j+Y) += sign * kyy;
+}
+
+// stiffness of a spring (k/l0) [(1 - e/len) u u' + (e/len) I], where
+// u is the unit vector along the spring.
+static void spring_stiffness(double k, double inv_l0, double dx, double dy, double len, double extn,
+        double *kxx, double *kxy, double *kyy) {
+    double c = k * inv_l0, r = extn / len, ux = dx / len, uy = dy / len;
+    *kxx = c * ((1 - r) * ux * ux + r);
+    *kxy = c * (1 - r) * ux * uy;
+    *kyy = c * ((1 - r) * uy * uy + r);
+}
+
+// hessian of calculate_energy() with respect to rim position (the
+// tangent stiffness), after calculate_data().  the load is linear in
+// position so does not contribute.
+void calculate_hessian(data *d, gsl_matrix *hessian) {
+
+    wheel *w = d->wheel;
+    int n = w->n_holes;
+    double kxx, kxy, kyy;
+    gsl_matrix_set_zero(hessian);
+
+    for (int i = 0; i < n; ++i) {
+        spring_stiffness(1e-3 * w->e_spoke, d->inv_l_spoke[i], d->spoke_x[i], d->spoke_y[i],
+                d->spoke_len[i], d->spoke_extn[i], &kxx, &kxy, &kyy);
+        add_block(hessian, i, i, 1, kxx, kxy, kyy);
+    }
+
+    for (int after = 0; after < n; ++after) {
+        int before = (after - 1 + n) % n;
+        spring_stiffness(1e-3 * w->e_rim, d->inv_l_chord[after], d->chord_x[after], d->chord_y[after],
+                d->chord_len[after], d->chord_extn[after], &kxx, &kxy, &kyy);
+        add_block(hessian, after, after, 1, kxx, kxy, kyy);
+        add_block(hessian, before, before, 1, kxx, kxy, kyy);
+        add_block(hessian, after, before, -1, kxx, kxy, kyy);
+        add_block(hessian, before, after, -1, kxx, kxy, kyy);
+    }
+}
+
+static void add_product(gsl_vector *ku, int i, int j, const gsl_vector *u, double sign,
+        double kxx, double kxy, double kyy) {
+    double ux = gsl_vector_get(u, 2*j+X), uy = gsl_vector_get(u, 2*j+Y);
+    *gsl_vector_ptr(ku, 2*i+X) += sign * (kxx * ux + kxy * uy);
+    *gsl_vector_ptr(ku, 2*i+Y) += sign * (kxy * ux + kyy * uy);
+}
+
+// calculate_hessian() times u, without the matrix.
+void hessian_times(data *d, const gsl_vector *u, gsl_vector *ku) {
+
+    wheel *w = d->wheel;
+    int n = w->n_holes;
+    double kxx, kxy, kyy;
+    gsl_vector_set_zero(ku);
+
+    for (int i = 0; i < n; ++i) {
+        spring_stiffness(1e-3 * w->e_spoke, d->inv_l_spoke[i], d->spoke_x[i], d->spoke_y[i],
+                d->spoke_len[i], d->spoke_extn[i], &kxx, &kxy, &kyy);
+        add_product(ku, i, i, u, 1, kxx, kxy, kyy);
+    }
+
+    for (int after = 0; after < n; ++after) {
+        int before = (after - 1 + n) % n;
+        spring_stiffness(1e-3 * w->e_rim, d->inv_l_chord[after], d->chord_x[after], d->chord_y[after],
+                d->chord_len[after], d->chord_extn[after], &kxx, &kxy, &kyy);
+        add_product(ku, after, after, u, 1, kxx, kxy, kyy);
+        add_product(ku, before, before, u, 1, kxx, kxy, kyy);
+        add_product(ku, after, before, u, -1, kxx, kxy, kyy);
+        add_product(ku, before, after, u, -1, kxx, kxy, kyy);
+    }
+}
+
+
+void free_circulant(circulant *c) {
+    if (c) {
+        for (int k = 0; k < c->wavenumbers; ++k) {
+            if (!c->shared && c->block && c->block[k]) gsl_matrix_complex_free(c->block[k]);
+            if (!c->shared && c->perm && c->perm[k]) gsl_permutation_free(c->perm[k]);
+            if (c->modes && c->modes[k]) gsl_vector_complex_free(c->modes[k]);
+        }
+        free(c->block);
+        free(c->perm);
+        free(c->modes);
+        if (c->rhs) gsl_vector_complex_free(c->rhs);
+        free(c);
+    }
+}
+
+int alloc_circulant(lulog *dbg, circulant **c, wheel *w, int cell) {
+    LU_STATUS
+    int period = 2 * w->n_offsets;
+    LU_ASSERT(!(w->n_holes % period), LU_ERR, dbg, "Pattern does not repeat (%d holes, period %d)",
+            w->n_holes, period)
+    LU_ALLOC(dbg, *c, 1)
+    (*c)->n = w->n_holes;
+    (*c)->period = period;
+    (*c)->repeats = w->n_holes / period;
+    (*c)->wavenumbers = cell ? 1 : (*c)->repeats;
+    LU_ALLOC(dbg, (*c)->block, (*c)->wavenumbers)
+    LU_ALLOC(dbg, (*c)->perm, (*c)->wavenumbers)
+    LU_ALLOC(dbg, (*c)->modes, (*c)->wavenumbers)
+    for (int k = 0; k < (*c)->wavenumbers; ++k) {
+        LU_ASSERT((*c)->block[k] = gsl_matrix_complex_alloc(2 * period, 2 * period),
+                LU_ERR_MEM, dbg, "Cannot allocate block")
+        LU_ASSERT((*c)->perm[k] = gsl_permutation_alloc(2 * period), LU_ERR_MEM, dbg, "Cannot allocate permutation")
+        LU_ASSERT((*c)->modes[k] = gsl_vector_complex_alloc(2 * period), LU_ERR_MEM, dbg, "Cannot allocate vector")
+    }
+    LU_ASSERT((*c)->rhs = gsl_vector_complex_alloc(2 * period), LU_ERR_MEM, dbg, "Cannot allocate vector")
+    ludebug(dbg, "Circulant stiffness: %d repeats of %d holes (%d blocks)", (*c)->repeats, period,
+            (*c)->wavenumbers);
+    LU_NO_CLEANUP
+}
+
+// the factorised blocks of from, with separate workspace, so that
+// several threads can solve at once.
+int share_circulant(lulog *dbg, circulant *from, circulant **c) {
+    LU_STATUS
+    int period = from->period;
+    LU_ALLOC(dbg, *c, 1)
+    **c = *from;
+    (*c)->shared = 1;
+    (*c)->block = NULL;
+    (*c)->perm = NULL;
+    (*c)->modes = NULL;
+    (*c)->rhs = NULL;
+    LU_ALLOC(dbg, (*c)->block, from->wavenumbers)
+    LU_ALLOC(dbg, (*c)->perm, from->wavenumbers)
+    LU_ALLOC(dbg, (*c)->modes, from->wavenumbers)
+    for (int k = 0; k < from->wavenumbers; ++k) {
+        (*c)->block[k] = from->block[k];
+        (*c)->perm[k] = from->perm[k];
+        LU_ASSERT((*c)->modes[k] = gsl_vector_complex_alloc(2 * period), LU_ERR_MEM, dbg, "Cannot allocate vector")
+    }
+    LU_ASSERT((*c)->rhs = gsl_vector_complex_alloc(2 * period), LU_ERR_MEM, dbg, "Cannot allocate vector")
+    LU_NO_CLEANUP
+}
+
+// holes run clockwise (see xy_on_circle())
+static double hole_angle(int i, int n) {
+    return -2 * M_PI * i / n;
+}
+
+// rotate from global xy to the frame of hole i (dir 1) or back (dir -1)
+static void rotate(int i, int n, int dir, double *x, double *y) {
+    double t = hole_angle(i, n), c = cos(t), s = dir * sin(t);
+    double x0 = *x, y0 = *y;
+    *x = c * x0 + s * y0;
+    *y = -s * x0 + c * y0;
+}
+
+// add the stiffness block between node i (in the first repeat) and node
+// j (anywhere), in local coordinates, to every wavenumber.
+static void add_circulant(circulant *c, int i, int j, double sign, double kxx, double kxy, double kyy) {
+    // columns of k R_j, then R_i' of those
+    double t = hole_angle(j, c->n), cj = cos(t), sj = sin(t);
+    double m00 = kxx * cj + kxy * sj, m10 = kxy * cj + kyy * sj;
+    double m01 = kxy * cj - kxx * sj, m11 = kyy * cj - kxy * sj;
+    rotate(i, c->n, 1, &m00, &m10);
+    rotate(i, c->n, 1, &m01, &m11);
+    double local[2][2] = {{m00, m01}, {m10, m11}};
+    int p = j / c->period, b = j % c->period;
+    for (int k = 0; k < c->wavenumbers; ++k) {
+        gsl_complex phase = gsl_complex_polar(sign, 2 * M_PI * k * p / c->repeats);
+        for (int r = 0; r < 2; ++r) {
+            for (int s = 0; s < 2; ++s) {
+                gsl_complex *z = gsl_matrix_complex_ptr(c->block[k], 2*i+r, 2*b+s);
+                *z = gsl_complex_add(*z, gsl_complex_mul_real(phase, local[r][s]));
+            }
+        }
+    }
+}
+
+// build and decompose the blocks from the first repeat, after
+// calculate_data().  zero if ok.
+int calculate_circulant(data *d, circulant *c) {
+
+    wheel *w = d->wheel;
+    int n = w->n_holes, signum;
+    double kxx, kxy, kyy;
+
+    for (int k = 0; k < c->wavenumbers; ++k) gsl_matrix_complex_set_zero(c->block[k]);
+
+    for (int i = 0; i < c->period; ++i) {
+        spring_stiffness(1e-3 * w->e_spoke, d->inv_l_spoke[i], d->spoke_x[i], d->spoke_y[i],
+                d->spoke_len[i], d->spoke_extn[i], &kxx, &kxy, &kyy);
+        add_circulant(c, i, i, 1, kxx, kxy, kyy);
+        // chord i is from i-1 to i, chord i+1 from i to i+1
+        int before = (i - 1 + n) % n, after = (i + 1) % n;
+        spring_stiffness(1e-3 * w->e_rim, d->inv_l_chord[i], d->chord_x[i], d->chord_y[i],
+                d->chord_len[i], d->chord_extn[i], &kxx, &kxy, &kyy);
+        add_circulant(c, i, i, 1, kxx, kxy, kyy);
+        add_circulant(c, i, before, -1, kxx, kxy, kyy);
+        spring_stiffness(1e-3 * w->e_rim, d->inv_l_chord[after], d->chord_x[after], d->chord_y[after],
+                d->chord_len[after], d->chord_extn[after], &kxx, &kxy, &kyy);
+        add_circulant(c, i, i, 1, kxx, kxy, kyy);
+        add_circulant(c, i, after, -1, kxx, kxy, kyy);
+    }
+
+    for (int k = 0; k < c->wavenumbers; ++k) {
+        if (gsl_linalg_complex_LU_decomp(c->block[k], c->perm[k], &signum)) return 1;
+    }
+    return 0;
+}
+
+// solve K u = f using the decomposed blocks.  zero if ok.
+int circulant_solve(circulant *c, const gsl_vector *f, gsl_vector *u) {
+
+    int n = c->n, m = c->repeats, period = c->period;
+    if (c->wavenumbers != m) return 1;
+
+    // f in local coordinates
+    for (int i = 0; i < n; ++i) {
+        double x = gsl_vector_get(f, 2*i+X), y = gsl_vector_get(f, 2*i+Y);
+        rotate(i, n, 1, &x, &y);
+        gsl_vector_set(u, 2*i+X, x);
+        gsl_vector_set(u, 2*i+Y, y);
+    }
+
+    for (int k = 0; k < m; ++k) {
+        gsl_vector_complex_set_zero(c->rhs);
+        for (int p = 0; p < m; ++p) {
+            gsl_complex phase = gsl_complex_polar(1, -2 * M_PI * k * p / m);
+            for (int a = 0; a < 2 * period; ++a) {
+                gsl_complex *z = gsl_vector_complex_ptr(c->rhs, a);
+                *z = gsl_complex_add(*z, gsl_complex_mul_real(phase, gsl_vector_get(u, 2 * period * p + a)));
+            }
+        }
+        if (gsl_linalg_complex_LU_solve(c->block[k], c->perm[k], c->rhs, c->modes[k])) return 1;
+    }
+
+    for (int p = 0; p < m; ++p) {
+        for (int a = 0; a < 2 * period; ++a) {
+            double v = 0;
+            for (int k = 0; k < m; ++k) {
+                gsl_complex phase = gsl_complex_polar(1, 2 * M_PI * k * p / m);
+                v += GSL_REAL(gsl_complex_mul(phase, gsl_vector_complex_get(c->modes[k], a)));
+            }
+            gsl_vector_set(u, 2 * period * p + a, v / m);
+        }
+    }
+
+    // back to global
+    for (int i = 0; i < n; ++i) rotate(i, n, -1, gsl_vector_ptr(u, 2*i+X), gsl_vector_ptr(u, 2*i+Y));
+
+    return 0;
+}
+
+// solve with the k = 0 block (the cell stiffness), in local coordinates.
+int cell_solve(circulant *c, const gsl_vector *f, gsl_vector *u) {
+    for (int a = 0; a < 2 * c->period; ++a) {
+        gsl_vector_complex_set(c->rhs, a, gsl_complex_rect(gsl_vector_get(f, a), 0));
+    }
+    if (gsl_linalg_complex_LU_solve(c->block[0], c->perm[0], c->rhs, c->modes[0])) return 1;
+    for (int a = 0; a < 2 * c->period; ++a) gsl_vector_set(u, a, GSL_REAL(gsl_vector_complex_get(c->modes[0], a)));
+    return 0;
+}
+
+// displacement of every hole from that of the first cell (local
+// coordinates), assuming the wheel is periodic.
+void cell_to_xy(circulant *c, const gsl_vector *cell, gsl_vector *xy) {
+    for (int i = 0; i < c->n; ++i) {
+        int a = i % c->period;
+        double x = gsl_vector_get(cell, 2*a+X), y = gsl_vector_get(cell, 2*a+Y);
+        rotate(i, c->n, -1, &x, &y);
+        gsl_vector_set(xy, 2*i+X, x);
+        gsl_vector_set(xy, 2*i+Y, y);
+    }
+}
+
+// gradient with respect to the first cell (local coordinates), given the
+// gradient with respect to every hole.
+void xy_to_cell(circulant *c, const gsl_vector *xy, gsl_vector *cell) {
+    gsl_vector_set_zero(cell);
+    for (int i = 0; i < c->n; ++i) {
+        int a = i % c->period;
+        double x = gsl_vector_get(xy, 2*i+X), y = gsl_vector_get(xy, 2*i+Y);
+        rotate(i, c->n, 1, &x, &y);
+        *gsl_vector_ptr(cell, 2*a+X) += x;
+        *gsl_vector_ptr(cell, 2*a+Y) += y;
+    }
+}
+
+double energy(const gsl_vector *coeff, void *params) {
+    data *d = (data*)params;
+    double energy;
+    d->n_f++;
+    calculate_data(coeff, d);
+    calculate_energy(d, &energy);
+//    ludebug(dbg, "Energy: %g", energy);
+    return energy;
+}
+
+void neg_force(const gsl_vector *coeff, void *params, gsl_vector *neg_force) {
+    data *d = (data*)params;
+    d->n_df++;
+    calculate_data(coeff, d);
+    calculate_neg_force(d, neg_force);
+}
+
+// energy and gradient via calculate_data(), leaving the data for the
+// hessian.
+void staged_energy_and_neg_force(const gsl_vector *coeff, data *d, double *energy, gsl_vector *neg_force) {
+    calculate_data(coeff, d);
+    calculate_energy(d, energy);
+    calculate_neg_force(d, neg_force);
+}
+
+// energy and gradient in a single pass (xy_coeff_to_rim only).  the
+// arrays in data are not updated.
+void fused_energy_and_neg_force(const gsl_vector *coeff, data *d, double *energy, gsl_vector *neg_force) {
+    wheel *w = d->wheel;
+    load *l = d->load;
+    *energy = d->k->fused(w->n_holes, 1e-3 * w->e_spoke, 1e-3 * w->e_rim, (const double*)w->rim, coeff->data,
+            d->hub_x, d->hub_y, d->l_spoke, d->inv_l_spoke, d->l_chord, d->inv_l_chord, neg_force->data);
+    if (l) {
+        l->end.x = w->rim[l->i_rim].x + gsl_vector_get(coeff, 2*l->i_rim+X);
+        l->end.y = w->rim[l->i_rim].y + gsl_vector_get(coeff, 2*l->i_rim+Y);
+        *energy += load_energy(l);
+        add_load_neg_force(l, neg_force);
+    }
+}
+
+// callers that need the data afterwards (eg for the hessian) must call
+// calculate_data() themselves.
+void energy_and_neg_force(const gsl_vector *coeff, void *params, double *energy, gsl_vector *neg_force) {
+    data *d = (data*)params;
+    d->n_f++;
+    d->n_df++;
+    if (d->to_rim == &xy_coeff_to_rim && coeff->stride == 1 && neg_force->stride == 1) {
+        fused_energy_and_neg_force(coeff, d, energy, neg_force);
+    } else {
+        staged_energy_and_neg_force(coeff, d, energy, neg_force);
+    }
+}
+
+// incremental evaluation.  after calculate_data() (with xy_coeff_to_rim)
+// and reset_incremental(), the energy and force of each spoke and rim
+// segment are cached, and moving a single rim node (or changing a single
+// spoke length) updates only the one spoke and two segments that it
+// touches.  the total is re-summed every n_holes moves so that rounding
+// does not accumulate.
+
+static double update_spoke(data *d, int i) {
+    wheel *w = d->wheel;
+    double k = 1e-3 * w->e_spoke;
+    d->k->extension(1, d->rim_x + i, d->rim_y + i, d->hub_x + i, d->hub_y + i, d->l_spoke + i,
+            d->spoke_x + i, d->spoke_y + i, d->spoke_len + i, d->spoke_extn + i);
+    d->k->force(1, k, d->spoke_extn + i, d->inv_l_spoke + i, d->spoke_x + i, d->spoke_y + i, d->spoke_len + i,
+            d->spoke_fx + i, d->spoke_fy + i);
+    double e = d->k->energy(1, k, d->spoke_extn + i, d->inv_l_spoke + i), delta = e - d->spoke_e[i];
+    d->spoke_e[i] = e;
+    return delta;
+}
+
+// chord i runs from i-1 to i
+static double update_chord(data *d, int i) {
+    wheel *w = d->wheel;
+    int before = (i - 1 + w->n_holes) % w->n_holes;
+    double k = 1e-3 * w->e_rim;
+    d->k->extension(1, d->rim_x + i, d->rim_y + i, d->rim_x + before, d->rim_y + before, d->l_chord + i,
+            d->chord_x + i, d->chord_y + i, d->chord_len + i, d->chord_extn + i);
+    d->k->force(1, k, d->chord_extn + i, d->inv_l_chord + i, d->chord_x + i, d->chord_y + i, d->chord_len + i,
+            d->chord_fx + i, d->chord_fy + i);
+    double e = d->k->energy(1, k, d->chord_extn + i, d->inv_l_chord + i), delta = e - d->chord_e[i];
+    d->chord_e[i] = e;
+    return delta;
+}
+
+static void sum_strain(data *d) {
+    d->strain = 0;
+    for (int i = 0; i < d->wheel->n_holes; ++i) d->strain += d->spoke_e[i] + d->chord_e[i];
+    d->n_moves = 0;
+}
+
+// cache element energies and forces for the current data.
+void reset_incremental(data *d) {
+    wheel *w = d->wheel;
+    int n = w->n_holes;
+    d->k->force(n, 1e-3 * w->e_spoke, d->spoke_extn, d->inv_l_spoke, d->spoke_x, d->spoke_y, d->spoke_len,
+            d->spoke_fx, d->spoke_fy);
+    d->k->force(n, 1e-3 * w->e_rim, d->chord_extn, d->inv_l_chord, d->chord_x, d->chord_y, d->chord_len,
+            d->chord_fx, d->chord_fy);
+    for (int i = 0; i < n; ++i) {
+        d->spoke_e[i] = d->k->energy(1, 1e-3 * w->e_spoke, d->spoke_extn + i, d->inv_l_spoke + i);
+        d->chord_e[i] = d->k->energy(1, 1e-3 * w->e_rim, d->chord_extn + i, d->inv_l_chord + i);
+    }
+    sum_strain(d);
+}
+
+// update the spoke and two segments at node i (without changing the
+// total), returning the change in energy.  nodes of the same parity share
+// no elements, so can be updated concurrently.
+double update_node(data *d, int i, xy p) {
+    wheel *w = d->wheel;
+    d->rim[i] = p;
+    d->offset[i] = sub(p, w->rim[i]);
+    d->rim_x[i] = p.x;
+    d->rim_y[i] = p.y;
+    if (d->load && d->load->i_rim == i) d->load->end = p;
+    return update_spoke(d, i) + update_chord(d, i) + update_chord(d, (i + 1) % w->n_holes);
+}
+
+static void add_strain(data *d, double delta) {
+    d->strain += delta;
+    if (++d->n_moves >= d->wheel->n_holes) sum_strain(d);
+}
+
+void move_rim(data *d, int i, xy p) {
+    add_strain(d, update_node(d, i, p));
+}
+
+// i is in rim order; the wheel is updated too.
+void set_l_spoke(data *d, int i, double l_spoke) {
+    wheel *w = d->wheel;
+    w->l_spoke[w->rim_to_hub[i]] = l_spoke;
+    d->l_spoke[i] = l_spoke;
+    d->inv_l_spoke[i] = 1 / l_spoke;
+    add_strain(d, update_spoke(d, i));
+}
+
+double incremental_energy(data *d) {
+    return d->strain + (d->load ? load_energy(d->load) : 0);
+}
+
+// negative force on node i (as calculate_neg_force()).
+xy rim_neg_force(data *d, int i) {
+    int after = (i + 1) % d->wheel->n_holes;
+    xy f = {d->spoke_fx[i] + d->chord_fx[i] - d->chord_fx[after],
+            d->spoke_fy[i] + d->chord_fy[i] - d->chord_fy[after]};
+    load *l = d->load;
+    if (l && l->i_rim == i) {
+        f.x -= l->g_norm.x * l->mass * G * 1e-3;
+        f.y -= l->g_norm.y * l->mass * G * 1e-3;
+    }
+    return f;
+}
+
+static double spring_energy(double k, xy a, xy b, double l0, double inv_l0) {
+    double extn = length(sub(a, b)) - l0;
+    return 0.5 * k * extn * extn * inv_l0;
+}
+
+// energy of the elements at node i (and the load) if it were at p,
+// without changing anything (for line searches along a single node).
+double node_energy_at(data *d, int i, xy p) {
+    wheel *w = d->wheel;
+    int n = w->n_holes, before = (i - 1 + n) % n, after = (i + 1) % n;
+    xy hub = {d->hub_x[i], d->hub_y[i]};
+    double e = spring_energy(1e-3 * w->e_spoke, p, hub, d->l_spoke[i], d->inv_l_spoke[i]);
+    e += spring_energy(1e-3 * w->e_rim, p, d->rim[before], d->l_chord[i], d->inv_l_chord[i]);
+    e += spring_energy(1e-3 * w->e_rim, d->rim[after], p, d->l_chord[after], d->inv_l_chord[after]);
+    load *l = d->load;
+    if (l && l->i_rim == i) e -= dot(sub(p, l->start), l->g_norm) * l->mass * G * 1e-3;
+    return e;
+}
+
+
+int alloc_arena(lulog *dbg, arena *a, size_t size) {
+    LU_STATUS
+    LU_ALLOC(dbg, a->base, size)
+    a->size = size;
+    a->used = 0;
+    LU_NO_CLEANUP
+}
+
+void *arena_take(arena *a, size_t n) {
+    double *p = NULL;
+    if (a->used + n <= a->size) {
+        p = a->base + a->used;
+        a->used += n;
+    }
+    return p;
+}
+
+
+int arena_data(lulog *dbg, arena *a, data **d, wheel *w, load *l) {
+    LU_STATUS
+    LU_ALLOC(dbg, *d, 1);
+    (*d)->wheel = w;
+    (*d)->load = l;
+    // scalar until stress -b (which compares the sets) shows the simd
+    // kernels are faster against libgsl.
+    (*d)->k = &scalar_kernels;
+    int n = w->n_holes;
+    xy **xys[N_DATA_XY] = {&(*d)->offset, &(*d)->rim};
+    double **doubles[N_DATA_DOUBLE] = {
+        &(*d)->rim_x, &(*d)->rim_y, &(*d)->hub_x, &(*d)->hub_y, &(*d)->l_spoke, &(*d)->l_chord,
+        &(*d)->inv_l_spoke, &(*d)->inv_l_chord,
+        &(*d)->spoke_x, &(*d)->spoke_y, &(*d)->spoke_len, &(*d)->spoke_extn,
+        &(*d)->chord_x, &(*d)->chord_y, &(*d)->chord_len, &(*d)->chord_extn,
+        &(*d)->spoke_fx, &(*d)->spoke_fy, &(*d)->chord_fx, &(*d)->chord_fy,
+        &(*d)->spoke_e, &(*d)->chord_e};
+    for (int i = 0; i < N_DATA_XY; ++i) {
+        LU_ASSERT(*xys[i] = ARENA_XY(a, n), LU_ERR_MEM, dbg, "Arena too small")
+    }
+    for (int i = 0; i < N_DATA_DOUBLE; ++i) {
+        LU_ASSERT(*doubles[i] = ARENA_DOUBLE(a, n), LU_ERR_MEM, dbg, "Arena too small")
+    }
+    refresh_data(*d);
+    LU_NO_CLEANUP
+}
+
+int arena_vector(lulog *dbg, arena *a, gsl_vector_view *v, size_t n) {
+    LU_STATUS
+    double *p = NULL;
+    LU_ASSERT(p = ARENA_DOUBLE(a, n), LU_ERR_MEM, dbg, "Arena too small")
+    *v = gsl_vector_view_array(p, n);
+    LU_NO_CLEANUP
+}
+
+// red-black gauss-seidel.  each node in turn is moved along its force to
+// the minimum of its local energy (the spoke and two rim segments it
+// touches, via the incremental evaluation).  nodes of one parity share no
+// elements, so each colour is split across threads (with an odd number
+// of holes the last node is a colour of its own).
+
+#define MAX_ITER_NODE 50
+#define MAX_NODE_STEP 10
+#define EPSABS 1e-9
+#define EPSREL 1e-6
+
+typedef struct {
+    data *d;
+    int i_rim;
+    xy zero;
+    xy descent;
+} node_line;
+
+double f_node_energy(double x, void *params) {
+    node_line *l = (node_line*)params;
+    return node_energy_at(l->d, l->i_rim, add(l->zero, scalar_mult(x, l->descent)));
+}
+
+// line minimisation of a single node along the force direction.  the
+// stiffness along the line gives a first guess, and the node cannot cross
+// the line between its neighbours.  returns the number of evaluations.
+int relax_node(data *d, int i_rim, gsl_min_fminimizer *min) {
+
+    wheel *w = d->wheel;
+    int n = w->n_holes, before = (i_rim - 1 + n) % n, after = (i_rim + 1) % n, n_eval = 3;
+    node_line line = {d, i_rim, d->rim[i_rim]};
+    xy g = rim_neg_force(d, i_rim);
+    double gradient = length(g);
+    if (!gradient) return 0;
+    // steepest descent is against the gradient
+    line.descent = scalar_mult(-1 / gradient, g);
+
+    double kxx, kxy, kyy, c = 0;
+    xy u = line.descent;
+    spring_stiffness(1e-3 * w->e_spoke, d->inv_l_spoke[i_rim], d->spoke_x[i_rim], d->spoke_y[i_rim],
+            d->spoke_len[i_rim], d->spoke_extn[i_rim], &kxx, &kxy, &kyy);
+    c += kxx * u.x * u.x + 2 * kxy * u.x * u.y + kyy * u.y * u.y;
+    for (int j = 0; j < 2; ++j) {
+        int k = j ? after : i_rim;
+        spring_stiffness(1e-3 * w->e_rim, d->inv_l_chord[k], d->chord_x[k], d->chord_y[k],
+                d->chord_len[k], d->chord_extn[k], &kxx, &kxy, &kyy);
+        c += kxx * u.x * u.x + 2 * kxy * u.x * u.y + kyy * u.y * u.y;
+    }
+
+    // distance along the descent to the line between the neighbours
+    xy along = norm(sub(d->rim[after], d->rim[before]));
+    xy perp = {-along.y, along.x};
+    double limit = -dot(perp, sub(line.zero, d->rim[before])) / dot(perp, line.descent);
+    double hi = limit > 0 ? fmin(limit, MAX_NODE_STEP) : MAX_NODE_STEP;
+    double guess = c > 0 ? gradient / c : hi / 2;
+    hi = fmin(hi, 2 * guess);
+    guess = fmin(guess, hi / 2);
+
+    gsl_function f = {f_node_energy, &line};
+    double f0 = f_node_energy(0, &line), f_guess = f_node_energy(guess, &line), f_hi = f_node_energy(hi, &line);
+    double x = 0;
+    if (f_guess < f0 && f_guess < f_hi && !gsl_min_fminimizer_set_with_values(min, &f, guess, f_guess, 0, f0, hi, f_hi)) {
+        for (int iter = 0; iter < MAX_ITER_NODE; ++iter, ++n_eval) {
+            if (gsl_min_fminimizer_iterate(min)) break;
+            if (gsl_min_test_interval(gsl_min_fminimizer_x_lower(min), gsl_min_fminimizer_x_upper(min),
+                    EPSABS, EPSREL) == GSL_SUCCESS) break;
+        }
+        x = gsl_min_fminimizer_x_minimum(min);
+    } else if (f_hi < f0 && f_hi <= f_guess) {
+        x = hi;
+    } else if (f_guess < f0) {
+        x = guess;
+    }
+    if (x) update_node(d, i_rim, add(line.zero, scalar_mult(x, line.descent)));
+    return n_eval;
+}
+
+
+typedef struct {
+    struct red_black *rb;
+    int id;
+} red_black_thread;
+
+// threads (id 1...) are started for each relax_gs(); the caller is id 0.
+typedef struct red_black {
+    data *d;
+    int n_threads;
+    gsl_min_fminimizer **min;   // one per thread
+    long *n_eval;               // local evaluations, one per thread
+    pthread_t *threads;
+    red_black_thread *args;
+    int n_started;
+    pthread_mutex_t lock;
+    pthread_cond_t go, done;
+    int colour;                 // to relax (-1 to exit)
+    int generation;             // incremented for each colour
+    int n_done;                 // threads finished with this generation
+} red_black;
+
+int alloc_red_black(lulog *dbg, red_black **rb, data *d, int n_threads) {
+    LU_STATUS
+    LU_ALLOC(dbg, *rb, 1)
+    (*rb)->d = d;
+    (*rb)->n_threads = n_threads;
+    LU_ALLOC(dbg, (*rb)->min, n_threads)
+    LU_ALLOC(dbg, (*rb)->n_eval, n_threads)
+    LU_ALLOC(dbg, (*rb)->threads, n_threads)
+    LU_ALLOC(dbg, (*rb)->args, n_threads)
+    for (int i = 0; i < n_threads; ++i) {
+        LU_ASSERT((*rb)->min[i] = gsl_min_fminimizer_alloc(gsl_min_fminimizer_quad_golden), LU_ERR_MEM, dbg,
+                "Cannot allocate line minimizer")
+        (*rb)->args[i].rb = *rb;
+        (*rb)->args[i].id = i;
+    }
+    LU_ASSERT(!pthread_mutex_init(&(*rb)->lock, NULL), LU_ERR, dbg, "Cannot create lock")
+    LU_ASSERT(!pthread_cond_init(&(*rb)->go, NULL), LU_ERR, dbg, "Cannot create condition")
+    LU_ASSERT(!pthread_cond_init(&(*rb)->done, NULL), LU_ERR, dbg, "Cannot create condition")
+    LU_NO_CLEANUP
+}
+
+void free_red_black(red_black *rb) {
+    if (rb) {
+        if (rb->min) {
+            for (int i = 0; i < rb->n_threads; ++i) if (rb->min[i]) gsl_min_fminimizer_free(rb->min[i]);
+        }
+        pthread_mutex_destroy(&rb->lock);
+        pthread_cond_destroy(&rb->go);
+        pthread_cond_destroy(&rb->done);
+        free(rb->min);
+        free(rb->n_eval);
+        free(rb->threads);
+        free(rb->args);
+        free(rb);
+    }
+}
+
+// colour 0 is even nodes, 1 odd, and 2 the last node if n_holes is odd.
+void relax_colour(red_black *rb, int colour, int id) {
+    int n = rb->d->wheel->n_holes, paired = n - n % 2, n_threads = rb->n_started + 1;
+    if (colour == 2) {
+        if (!id) rb->n_eval[id] += relax_node(rb->d, n - 1, rb->min[id]);
+    } else {
+        for (int i = colour + 2 * id; i < paired; i += 2 * n_threads) {
+            rb->n_eval[id] += relax_node(rb->d, i, rb->min[id]);
+        }
+    }
+}
+
+void *red_black_worker(void *arg) {
+    red_black_thread *t = (red_black_thread*)arg;
+    red_black *rb = t->rb;
+    int generation = 0;
+    pthread_mutex_lock(&rb->lock);
+    while (1) {
+        while (rb->generation == generation) pthread_cond_wait(&rb->go, &rb->lock);
+        generation = rb->generation;
+        if (rb->colour < 0) break;
+        int colour = rb->colour;
+        pthread_mutex_unlock(&rb->lock);
+        relax_colour(rb, colour, t->id);
+        pthread_mutex_lock(&rb->lock);
+        if (++rb->n_done == rb->n_started) pthread_cond_signal(&rb->done);
+    }
+    pthread_mutex_unlock(&rb->lock);
+    return NULL;
+}
+
+// relax one colour on all threads, returning when all are done.
+void run_colour(red_black *rb, int colour) {
+    if (rb->n_started) {
+        pthread_mutex_lock(&rb->lock);
+        rb->colour = colour;
+        rb->n_done = 0;
+        rb->generation++;
+        pthread_cond_broadcast(&rb->go);
+        pthread_mutex_unlock(&rb->lock);
+    }
+    relax_colour(rb, colour, 0);
+    if (rb->n_started) {
+        pthread_mutex_lock(&rb->lock);
+        while (rb->n_done < rb->n_started) pthread_cond_wait(&rb->done, &rb->lock);
+        pthread_mutex_unlock(&rb->lock);
+    }
+}
+
+int start_red_black(lulog *dbg, red_black *rb) {
+    LU_STATUS
+    rb->n_started = 0;
+    rb->generation = 0;
+    for (int i = 0; i < rb->n_threads; ++i) rb->n_eval[i] = 0;
+    for (int i = 1; i < rb->n_threads; ++i, ++rb->n_started) {
+        LU_ASSERT(!pthread_create(&rb->threads[i], NULL, red_black_worker, &rb->args[i]), LU_ERR, dbg,
+                "Cannot start thread")
+    }
+    LU_NO_CLEANUP
+}
+
+void stop_red_black(red_black *rb) {
+    if (rb->n_started) {
+        pthread_mutex_lock(&rb->lock);
+        rb->colour = -1;
+        rb->generation++;
+        pthread_cond_broadcast(&rb->go);
+        pthread_mutex_unlock(&rb->lock);
+        for (int i = 1; i <= rb->n_started; ++i) pthread_join(rb->threads[i], NULL);
+        rb->n_started = 0;
+    }
+}
+
+
+// comma separated list of method names
+int parse_pipeline(lulog *dbg, const char *spec, options *opts) {
+    LU_STATUS
+    const char *p = spec;
+    opts->n_pipeline = 0;
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        int found = 0;
+        for (method m = 0; m < n_method && !found; ++m) {
+            if (strlen(method_names[m]) == len && !strncmp(p, method_names[m], len)) {
+                LU_ASSERT(opts->n_pipeline < MAX_PIPELINE, LU_ERR, dbg, "Too many methods in %s", spec)
+                opts->pipeline[opts->n_pipeline++] = m;
+                found = 1;
+            }
+        }
+        LU_ASSERT(found, LU_ERR, dbg, "Unknown method in %s", spec)
+        p += len;
+        if (*p) p++;
+    }
+    LU_ASSERT(opts->n_pipeline, LU_ERR, dbg, "No methods in '%s'", spec)
+    // relax() skips cell under load, so something else must follow it
+    int loaded = 0;
+    for (int i = 0; i < opts->n_pipeline; ++i) loaded |= opts->pipeline[i] != method_cell;
+    LU_ASSERT(loaded, LU_ERR, dbg, "No method in '%s' can relax a loaded wheel", spec)
+    LU_NO_CLEANUP
+}
+
+// seconds for the whole run, or name=seconds (name from phase_names or
+// total), comma separated.
+int parse_budget(lulog *dbg, const char *spec, options *opts) {
+    LU_STATUS
+    const char *p = spec;
+    int used = 0;
+    if (sscanf(p, "%lf%n", &opts->total_budget, &used) == 1 && !p[used]) {
+        LU_ASSERT(opts->total_budget > 0, LU_ERR_ARG, dbg, "Bad budget %s", spec)
+        goto exit;
+    }
+    while (*p) {
+        size_t len = strcspn(p, "=");
+        double *seconds = NULL;
+        if (len == 5 && !strncmp(p, "total", len)) seconds = &opts->total_budget;
+        for (phase i = 0; i < n_phase && !seconds; ++i) {
+            if (strlen(phase_names[i]) == len && !strncmp(p, phase_names[i], len)) seconds = &opts->budget[i];
+        }
+        LU_ASSERT(seconds, LU_ERR_ARG, dbg, "Unknown phase in %s", spec)
+        LU_ASSERT(sscanf(p + len, "=%lf%n", seconds, &used) == 1 && *seconds > 0,
+                LU_ERR_ARG, dbg, "Bad budget in %s", spec)
+        p += len + used;
+        LU_ASSERT(!*p || *p == ',', LU_ERR_ARG, dbg, "Bad budget %s", spec)
+        if (*p) p++;
+    }
+    LU_NO_CLEANUP
+}
+
+int in_pipeline(options *opts, method m) {
+    for (int i = 0; i < opts->n_pipeline; ++i) if (opts->pipeline[i] == m) return 1;
+    return 0;
+}
+
+const gsl_multimin_fdfminimizer_type *fdf_type(method m) {
+    switch (m) {
+    case method_sd: return gsl_multimin_fdfminimizer_steepest_descent;
+    case method_cg: return gsl_multimin_fdfminimizer_conjugate_fr;
+    case method_bfgs2: return gsl_multimin_fdfminimizer_vector_bfgs2;
+    default: return NULL;
+    }
+}
+
+// the deadline is the end of the run or of this phase, whichever is
+// sooner.
+void start_phase(solver *s, phase p) {
+    options *opts = s->opts;
+    s->trace->phase = p;
+    s->timed_out = 0;
+    s->deadline = opts->total_budget > 0 ? opts->total_budget : INFINITY;
+    if (opts->budget[p] > 0) s->deadline = fmin(s->deadline, elapsed(&s->created) + opts->budget[p]);
+}
+
+// true if iteration should stop (keeping the best so far) because of
+// sigint or the budget.  a single (vdso) clock read, so cheap next to
+// any iteration.
+int stop_early(solver *s) {
+    lulog *dbg = s->ctx->log;
+    if (s->ctx->cancel) return 1;
+    if (!s->timed_out && s->deadline < INFINITY && elapsed(&s->created) > s->deadline) {
+        luwarn(dbg, "Out of time in phase %s after %.3fs", phase_names[s->trace->phase], elapsed(&s->created));
+        s->timed_out = 1;
+    }
+    return s->timed_out;
+}
+
+// why an unconverged loop stopped
+quality stop_quality(solver *s) {
+    return s->timed_out ? quality_budget : s->ctx->cancel ? quality_interrupted : quality_unconverged;
+}
+
+void note_quality(solver *s, quality q) {
+    phase p = s->trace->phase;
+    if (q > s->quality[p]) s->quality[p] = q;
+}
+
+// worst over all phases
+quality run_quality(solver *s) {
+    quality q = quality_converged;
+    for (phase p = 0; p < n_phase; ++p) if (s->quality[p] > q) q = s->quality[p];
+    return q;
+}
+
+int alloc_solver(spokes *ctx, solver **s, wheel *w, options *opts) {
+    LU_STATUS
+    lulog *dbg = ctx->log;
+    int n = w->n_holes, newton = in_pipeline(opts, method_newton), cell = in_pipeline(opts, method_cell);
+    int period = 2 * w->n_offsets, repeats = !(n % period) && n > period;
+    // the linear prediction (see predict()) also needs the vectors, and
+    // the dense hessian when the pattern does not repeat
+    int dense = newton || !repeats;
+    LU_ALLOC(dbg, *s, 1)
+    (*s)->ctx = ctx;
+    (*s)->wheel = w;
+    (*s)->opts = opts;
+    LU_CHECK(alloc_trace(dbg, opts->trace, &(*s)->trace))
+    // arrays in data, 2 more xy arrays in solver, 6 vectors (and dense, cell)
+    LU_CHECK(alloc_arena(dbg, &(*s)->arena, (2 * (N_DATA_XY + 2) + N_DATA_DOUBLE + 6 * 2) * n
+            + (dense ? 4 * n * n : 0) + (cell ? 4 * 2 * period : 0)))
+    LU_CHECK(arena_data(dbg, &(*s)->arena, &(*s)->d, w, NULL))
+    LU_CHECK(arena_vector(dbg, &(*s)->arena, &(*s)->coeff, 2 * n))
+    LU_CHECK(arena_vector(dbg, &(*s)->arena, &(*s)->step, 2 * n))
+    LU_CHECK(arena_vector(dbg, &(*s)->arena, &(*s)->neg_force, 2 * n))
+    LU_ASSERT((*s)->start = ARENA_XY(&(*s)->arena, n), LU_ERR_MEM, dbg, "Arena too small")
+    LU_ASSERT((*s)->shift = ARENA_XY(&(*s)->arena, n), LU_ERR_MEM, dbg, "Arena too small")
+    for (method m = 0; m < n_method; ++m) {
+        if (fdf_type(m) && in_pipeline(opts, m)) {
+            LU_ASSERT((*s)->fdf[m] = gsl_multimin_fdfminimizer_alloc(fdf_type(m), 2 * n),
+                    LU_ERR_MEM, dbg, "Cannot allocate %s minimizer", method_names[m])
+        }
+    }
+    if (in_pipeline(opts, method_nm)) {
+        LU_ASSERT((*s)->f = gsl_multimin_fminimizer_alloc(gsl_multimin_fminimizer_nmsimplex, 2 * n),
+                LU_ERR_MEM, dbg, "Cannot allocate f minimizer")
+    }
+    LU_CHECK(arena_vector(dbg, &(*s)->arena, &(*s)->gradient, 2 * n))
+    LU_CHECK(arena_vector(dbg, &(*s)->arena, &(*s)->dx, 2 * n))
+    LU_CHECK(arena_vector(dbg, &(*s)->arena, &(*s)->x1, 2 * n))
+    if (dense) {
+        double *h = NULL;
+        LU_ASSERT(h = ARENA_DOUBLE(&(*s)->arena, 4 * n * n), LU_ERR_MEM, dbg, "Arena too small")
+        (*s)->hessian = gsl_matrix_view_array(h, 2 * n, 2 * n);
+        LU_ASSERT((*s)->perm = gsl_permutation_alloc(2 * n), LU_ERR_MEM, dbg, "Cannot allocate permutation")
+    }
+    if (repeats) LU_CHECK(alloc_circulant(dbg, &(*s)->circ, w, 0))
+    if (in_pipeline(opts, method_ml)) {
+        for (int modes = MIN_MODES; (*s)->n_levels < MAX_LEVELS; modes *= 2) {
+            int level = (*s)->n_levels++;
+            (*s)->level_modes[level] = modes < n ? modes : n;
+            LU_ASSERT((*s)->f_level[level] = gsl_multimin_fminimizer_alloc(gsl_multimin_fminimizer_nmsimplex,
+                    2 * (*s)->level_modes[level]), LU_ERR_MEM, dbg, "Cannot allocate f minimizer")
+            if (modes >= n) break;
+        }
+    }
+    if (in_pipeline(opts, method_gs)) {
+        LU_CHECK(alloc_red_black(dbg, &(*s)->rb, (*s)->d, opts->n_threads > 0 ? opts->n_threads : 1))
+    }
+    if (cell) {
+        LU_CHECK(alloc_circulant(dbg, &(*s)->cell, w, 1))
+        LU_CHECK(arena_vector(dbg, &(*s)->arena, &(*s)->cell_x, 2 * period))
+        LU_CHECK(arena_vector(dbg, &(*s)->arena, &(*s)->cell_g, 2 * period))
+        LU_CHECK(arena_vector(dbg, &(*s)->arena, &(*s)->cell_dx, 2 * period))
+        LU_CHECK(arena_vector(dbg, &(*s)->arena, &(*s)->cell_x1, 2 * period))
+    }
+    ludebug(dbg, "Solver arena %zu doubles", (*s)->arena.used);
+    clock_gettime(CLOCK_MONOTONIC, &(*s)->created);
+    start_phase(*s, phase_lace);
+    LU_NO_CLEANUP
+}
+
+void free_solver(solver *s) {
+    if (s) {
+        free(s->d);
+        for (method m = 0; m < n_method; ++m) {
+            if (s->fdf[m]) gsl_multimin_fdfminimizer_free(s->fdf[m]);
+        }
+        if (s->f) gsl_multimin_fminimizer_free(s->f);
+        for (int i = 0; i < s->n_levels; ++i) gsl_multimin_fminimizer_free(s->f_level[i]);
+        if (s->perm) gsl_permutation_free(s->perm);
+        free_circulant(s->circ);
+        free_circulant(s->cell);
+        free_red_black(s->rb);
+        free(s->arena.base);
+        free_trace(s->trace, LU_OK);
+        free(s);
+    }
+}
+
+// true if, over the last STALL_WINDOW iterations, the energy has not
+// fallen (relatively) by more than STALL_ENERGY and the gradient norm
+// has not fallen by STALL_GRADIENT (gradient may be NAN if unknown).
+int stalled(solver *s, int iter, double energy, double gradient) {
+    lulog *dbg = s->ctx->log;
+    int i = iter % STALL_WINDOW, stall = 0;
+    if (iter >= STALL_WINDOW) {
+        double e0 = s->stall_energy[i], g0 = s->stall_gradient[i];
+        int flat = e0 - energy <= STALL_ENERGY * fabs(e0);
+        int slow = isnan(gradient) || isnan(g0) || gradient > STALL_GRADIENT * g0;
+        stall = flat && slow;
+        if (stall) ludebug(dbg, "Stalled at %d (energy %g -> %g, gradient %g -> %g)",
+                iter, e0, energy, g0, gradient);
+    }
+    s->stall_energy[i] = energy;
+    s->stall_gradient[i] = gradient;
+    return stall;
+}
+
+int hit_budget(solver *s) {
+    for (phase p = 0; p < n_phase; ++p) if (s->quality[p] == quality_budget) return 1;
+    return 0;
+}
+
+void quality_summary(solver *s) {
+    lulog *dbg = s->ctx->log;
+    for (phase p = 0; p < n_phase; ++p) {
+        if (s->trace->relaxations[p] || s->quality[p]) luinfo(dbg, "Phase %s: %s", phase_names[p], quality_names[s->quality[p]]);
+    }
+}
+
+// the first loaded step has nothing to extrapolate from, so starts from
+// the linear response of the (unloaded) wheel to the change in load.
+static int predict_linear(solver *s, load *l, double dmass) {
+
+    LU_STATUS
+    lulog *dbg = s->ctx->log;
+    wheel *w = s->wheel;
+    data *d = s->d;
+    int n = w->n_holes, signum;
+    gsl_vector *f = &s->gradient.vector, *u = &s->dx.vector;
+
+    d->to_rim = &xy_coeff_to_rim;
+    d->load = NULL;
+    gsl_vector_set_zero(&s->coeff.vector);
+    calculate_data(&s->coeff.vector, d);
+    // as add_load_neg_force()
+    gsl_vector_set_zero(f);
+    gsl_vector_set(f, 2*l->i_rim+X, l->g_norm.x * dmass * G * 1e-3);
+    gsl_vector_set(f, 2*l->i_rim+Y, l->g_norm.y * dmass * G * 1e-3);
+    // the blocks are close for a trued wheel, which is enough for a
+    // starting point; otherwise the dense stiffness (in the arena).
+    if (!s->circ || calculate_circulant(d, s->circ) || circulant_solve(s->circ, f, u)) {
+        gsl_matrix *h = &s->hessian.matrix;
+        LU_ASSERT(s->perm, LU_ERR, dbg, "No dense stiffness")
+        calculate_hessian(d, h);
+        LU_ASSERT(!gsl_linalg_LU_decomp(h, s->perm, &signum) && !gsl_linalg_LU_solve(h, s->perm, f, u),
+                LU_ERR, dbg, "Stiffness is singular")
+    }
+    ludebug(dbg, "Linear prediction for %gkg", dmass);
+    for (int i = 0; i < n; ++i) {
+        w->rim[i].x += gsl_vector_get(u, 2*i+X);
+        w->rim[i].y += gsl_vector_get(u, 2*i+Y);
+    }
+
+    LU_NO_CLEANUP
+}
+
+// move the rim to where we expect it to be for the given load, assuming
+// the response is linear in the load: extrapolated from the last two
+// relax() calls if they were for different loads, or from the stiffness.
+// a failed prediction only loses the better start.
+void predict(solver *s, load *l) {
+    lulog *dbg = s->ctx->log;
+    double mass = l ? l->mass : 0;
+    if (mass == s->mass) return;
+    if (s->mass != s->prev_mass) {
+        wheel *w = s->wheel;
+        double k = (mass - s->mass) / (s->mass - s->prev_mass);
+        ludebug(dbg, "Predicting rim for %gkg (scale %g)", mass, k);
+        for (int i = 0; i < w->n_holes; ++i) {
+            w->rim[i] = add(w->rim[i], scalar_mult(k, s->shift[i]));
+        }
+    } else if (l && predict_linear(s, l, mass - s->mass)) {
+        luwarn(dbg, "No linear prediction for %gkg", mass);
+    }
+}
+
+void log_energy(solver *s, const char *msg, double *final_energy, double *final_force) {
+    lulog *dbg = s->ctx->log;
+    double energy, total;
+    gsl_vector *neg_force = &s->neg_force.vector;
+    calculate_energy(s->d, &energy);
+    calculate_neg_force(s->d, neg_force);
+    total = sum_force(s->wheel, neg_force);
+    luinfo(dbg, "%s: Energy %g, Force %g", msg, energy, total);
+    if (final_energy) *final_energy = energy;
+    if (final_force) *final_force = total;
+}
+
+void update_rim(lulog *dbg, gsl_vector *coeff, data *d, wheel *w) {
+    double shift = 0.0;
+    calculate_data(coeff, d);
+    for (int i = 0; i < w->n_holes; ++i) {
+        xy delta = sub(d->rim[i], w->rim[i]);
+        shift += length(delta);
+        w->rim[i] = d->rim[i];
+    }
+    shift = shift / w->n_holes;
+    ludebug(dbg, "Average shift %gmm", shift);
+}
+
+int relax_f_fourier(solver *s, load *load) {
+
+    LU_STATUS
+    lulog *dbg = s->ctx->log;
+    wheel *wheel = s->wheel;
+    gsl_multimin_function callbacks;
+    data *d = s->d;
+    int gsl_status = GSL_CONTINUE, iter = 0;
+
+    d->to_rim = &fourier_coeff_to_rim;
+    d->load = load;
+    gsl_vector_set_zero(&s->coeff.vector);
+
+    calculate_data(&s->coeff.vector, d);
+    log_energy(s, "Before relax f Fourier", NULL, NULL);
+
+    callbacks.n = 2 * wheel->n_holes;
+    callbacks.params = d;
+    callbacks.f = energy;
+
+//    luinfo(dbg, "Method %s", gsl_multimin_fminimizer_name(s->f));
+    gsl_vector_set_all(&s->step.vector, 1e-4);
+    trace_start(s->trace);
+    d->n_f = d->n_df = 0;
+    gsl_multimin_fminimizer_set(s->f, &callbacks, &s->coeff.vector, &s->step.vector);
+
+    for (; iter < MAX_ITER_OUTER && gsl_status == GSL_CONTINUE && !stop_early(s); ++iter) {
+//        ludebug(dbg, "Iteration %d", iter);
+        gsl_status = gsl_multimin_fminimizer_iterate(s->f);
+        if (gsl_status == GSL_ENOPROG) {
+            luwarn(dbg, "Cannot progress");
+        } else if (!gsl_status) {
+            double size = gsl_multimin_fminimizer_size(s->f);
+            trace_iteration(s->trace, method_names[method_nm], iter, s->f->fval, NAN, size);
+            if (!iter || !(iter & (iter - 1))) ludebug(dbg, "Size %g (%d)", size, iter);
+            gsl_status = gsl_multimin_test_size(size, MAX_SIZE);
+            if (gsl_status == GSL_SUCCESS) luinfo(dbg, "Minimum energy: %g", s->f->fval);
+            else if (stalled(s, iter, s->f->fval, NAN)) break;
+        }
+    }
+
+    trace_end(s->trace, iter, d->n_f, d->n_df);
+    calculate_data(s->f->x, d);  // not the last trial point
+    log_energy(s, "After relax f Fourier", &s->energy, &s->force);
+    update_rim(dbg, s->f->x, d, wheel);
+
+    LU_NO_CLEANUP
+}
+
+// nelder-mead on the lowest modes first, doubling the number of modes at
+// each level and starting from the previous minimum (higher modes zero),
+// since most of the deformation is in the low modes.  coarse levels stop
+// at LEVEL_SIZE; only the last (all modes) goes to MAX_SIZE.
+int relax_f_multilevel(solver *s, load *load) {
+
+    LU_STATUS
+    lulog *dbg = s->ctx->log;
+    wheel *wheel = s->wheel;
+    gsl_multimin_function callbacks;
+    data *d = s->d;
+    gsl_vector *x = &s->coeff.vector;
+    int total = 0;
+
+    d->to_rim = &fourier_coeff_to_rim;
+    d->load = load;
+    gsl_vector_set_zero(&s->coeff.vector);
+
+    calculate_data(&s->coeff.vector, d);
+    log_energy(s, "Before relax multilevel", NULL, NULL);
+
+    callbacks.params = d;
+    callbacks.f = energy;
+
+    gsl_vector_set_all(&s->step.vector, 1e-4);
+    trace_start(s->trace);
+    d->n_f = d->n_df = 0;
+
+    for (int level = 0; level < s->n_levels && !stop_early(s); ++level) {
+        gsl_multimin_fminimizer *f = s->f_level[level];
+        int n_coeff = 2 * s->level_modes[level], gsl_status = GSL_CONTINUE, iter = 0;
+        double max_size = level == s->n_levels - 1 ? MAX_SIZE : LEVEL_SIZE;
+        gsl_vector_view coeff = gsl_vector_subvector(&s->coeff.vector, 0, n_coeff);
+        gsl_vector_view step = gsl_vector_subvector(&s->step.vector, 0, n_coeff);
+        // warm start from the previous level
+        if (level) {
+            gsl_vector_view prev = gsl_vector_subvector(&s->coeff.vector, 0, x->size);
+            gsl_vector_memcpy(&prev.vector, x);
+        }
+        callbacks.n = n_coeff;
+        gsl_multimin_fminimizer_set(f, &callbacks, &coeff.vector, &step.vector);
+        for (; iter < MAX_ITER_OUTER && gsl_status == GSL_CONTINUE && !stop_early(s); ++iter, ++total) {
+            gsl_status = gsl_multimin_fminimizer_iterate(f);
+            if (gsl_status == GSL_ENOPROG) {
+                luwarn(dbg, "Cannot progress");
+            } else if (!gsl_status) {
+                double size = gsl_multimin_fminimizer_size(f);
+                trace_iteration(s->trace, method_names[method_ml], total, f->fval, NAN, size);
+                gsl_status = gsl_multimin_test_size(size, max_size);
+                if (gsl_status != GSL_SUCCESS && stalled(s, iter, f->fval, NAN)) break;
+            }
+        }
+        ludebug(dbg, "Level %d: %d modes, energy %g after %d iterations", level, n_coeff / 2, f->fval, iter);
+        x = f->x;
+    }
+
+    trace_end(s->trace, total, d->n_f, d->n_df);
+    calculate_data(x, d);
+    log_energy(s, "After relax multilevel", &s->energy, &s->force);
+    update_rim(dbg, x, d, wheel);
+
+    LU_NO_CLEANUP
+}
+
+// data must be for the current rim (no offset)
+void spoke_tensions(data *d, double *tension) {
+    wheel *w = d->wheel;
+    for (int i = 0; i < w->n_holes; ++i) tension[i] = w->e_spoke * d->spoke_extn[i] * d->inv_l_spoke[i];
+}
+
+double vec_len(const gsl_vector *v) {
+    double l = 0;
+    for (int i = 0; i < v->size; ++i) l = l + gsl_vector_get(v, i) * gsl_vector_get(v, i);
+    return sqrt(l);
+}
+
+int relax_fdf_xy(solver *s, method m, load *load) {
+
+    LU_STATUS
+    lulog *dbg = s->ctx->log;
+    wheel *wheel = s->wheel;
+    gsl_multimin_function_fdf callbacks;
+    gsl_multimin_fdfminimizer *fdf = s->fdf[m];
+    data *d = s->d;
+    int gsl_status = GSL_CONTINUE, iter = 0;
+
+    d->to_rim = &xy_coeff_to_rim;
+    d->load = load;
+    gsl_vector_set_zero(&s->coeff.vector);
+
+    calculate_data(&s->coeff.vector, d);
+    log_energy(s, "Before relax fdf xy", NULL, NULL);
+
+    callbacks.n = 2 * wheel->n_holes;
+    callbacks.params = d;
+    callbacks.f = energy;
+    callbacks.df = neg_force;
+    callbacks.fdf = energy_and_neg_force;
+
+    ludebug(dbg, "Method %s", gsl_multimin_fdfminimizer_name(fdf));
+    trace_start(s->trace);
+    d->n_f = d->n_df = 0;
+    gsl_multimin_fdfminimizer_set(fdf, &callbacks, &s->coeff.vector, 1e-4, 1e-3);
+
+    for (; iter < MAX_ITER_OUTER && gsl_status == GSL_CONTINUE && !stop_early(s); ++iter) {
+//        ludebug(dbg, "Iteration %d", iter);
+        gsl_status = gsl_multimin_fdfminimizer_iterate(fdf);
+        if (gsl_status == GSL_ENOPROG) {
+            luwarn(dbg, "Cannot progress");
+        } else if (!gsl_status) {
+            double gradient = vec_len(fdf->gradient);
+            trace_iteration(s->trace, method_names[m], iter, fdf->f, gradient, NAN);
+            gsl_status = gsl_multimin_test_gradient(fdf->gradient, 1e-4);
+            if (!iter || !(iter & (iter - 1))) ludebug(dbg, "Gradient %g (%d)", gradient, iter);
+            if (gsl_status == GSL_SUCCESS) luinfo(dbg, "Minimum energy: %g", fdf->f);
+            else if (stalled(s, iter, fdf->f, gradient)) break;
+        }
+    }
+
+    trace_end(s->trace, iter, d->n_f, d->n_df);
+    calculate_data(fdf->x, d);  // the fused fdf leaves the data stale
+    log_energy(s, "After relax fdf xy", &s->energy, &s->force);
+    update_rim(dbg, fdf->x, d, wheel);
+
+    LU_NO_CLEANUP
+}
+
+#define MAX_DAMPING 10
+
+// newton's method using the analytic hessian, with a backtracking line
+// search.  compressed springs can make the hessian indefinite, so the
+// diagonal is damped (levenberg-marquardt style) when necessary.
+int relax_newton(solver *s, load *load) {
+
+    LU_STATUS
+    lulog *dbg = s->ctx->log;
+    data *d = s->d;
+    gsl_vector *x = &s->coeff.vector, *g = &s->gradient.vector;
+    gsl_vector *dx = &s->dx.vector, *x1 = &s->x1.vector;
+    gsl_matrix *h = &s->hessian.matrix;
+    int iter = 0, signum, dense = 0;
+    double e, e1, slope;
+
+    d->to_rim = &xy_coeff_to_rim;
+    d->load = load;
+    gsl_vector_set_zero(x);
+
+    calculate_data(x, d);
+    log_energy(s, "Before relax newton", NULL, NULL);
+
+    trace_start(s->trace);
+    d->n_f = d->n_df = 0;
+
+    for (; iter < MAX_ITER_OUTER && !stop_early(s); ++iter) {
+        energy_and_neg_force(x, d, &e, g);
+        double gradient = vec_len(g);
+        trace_iteration(s->trace, method_names[method_newton], iter, e, gradient, NAN);
+        if (!iter || !(iter & (iter - 1))) ludebug(dbg, "Gradient %g (%d)", gradient, iter);
+        if (gsl_multimin_test_gradient(g, 1e-4) == GSL_SUCCESS) {
+            luinfo(dbg, "Minimum energy: %g", e);
+            break;
+        }
+        if (stalled(s, iter, e, gradient)) break;
+        // unloaded, the (nearly) periodic stiffness can be solved in blocks.
+        calculate_data(x, d);
+        slope = 0;
+        if (!load && s->circ && !dense && !calculate_circulant(d, s->circ) && !circulant_solve(s->circ, g, dx)) {
+            gsl_vector_scale(dx, -1);
+            gsl_blas_ddot(dx, g, &slope);
+        }
+        // if the step is not downhill, add damping to the diagonal until it is.
+        double lambda = 0, scale = 0;
+        for (int k = 0; k < MAX_DAMPING && slope >= 0; ++k) {
+            calculate_hessian(d, h);
+            for (int j = 0; j < h->size1; ++j) {
+                if (!k) scale = fmax(scale, fabs(gsl_matrix_get(h, j, j)));
+                gsl_matrix_set(h, j, j, gsl_matrix_get(h, j, j) + lambda);
+            }
+            slope = 0;
+            if (!gsl_linalg_LU_decomp(h, s->perm, &signum) && !gsl_linalg_LU_solve(h, s->perm, g, dx)) {
+                gsl_vector_scale(dx, -1);
+                gsl_blas_ddot(dx, g, &slope);
+            }
+            if (slope < 0) break;
+            lambda = lambda ? 10 * lambda : 1e-6 * scale;
+        }
+        if (slope >= 0) {
+            ludebug(dbg, "No descent direction at %d", iter);
+            gsl_vector_memcpy(dx, g);
+            gsl_vector_scale(dx, -1 / scale);
+            slope = -gradient * gradient / scale;
+        }
+        double alpha = 1;
+        for (; alpha > MIN_NEWTON_STEP; alpha *= 0.5) {
+            gsl_vector_memcpy(x1, x);
+            gsl_blas_daxpy(alpha, dx, x1);
+            e1 = energy(x1, d);
+            if (e1 <= e + 1e-4 * alpha * slope) break;
+        }
+        if (alpha <= MIN_NEWTON_STEP) {
+            if (!load && s->circ && !dense) {
+                ludebug(dbg, "Circulant step failed at %d; using full hessian", iter);
+                dense = 1;
+                continue;
+            }
+            luwarn(dbg, "Cannot progress");
+            break;
+        }
+        gsl_vector_memcpy(x, x1);
+    }
+
+    trace_end(s->trace, iter, d->n_f, d->n_df);
+    calculate_data(x, d);
+    log_energy(s, "After relax newton", &s->energy, &s->force);
+    update_rim(dbg, x, d, s->wheel);
+
+    LU_NO_CLEANUP
+}
+
+// with no load every repeat of the pattern moves in the same way (in
+// coordinates that rotate with the hole), so newton's method needs only
+// the 4L coordinates of the first cell.  the energy is still that of the
+// whole wheel (m times the cell), which keeps the usual tests and trace.
+int relax_cell(solver *s) {
+
+    LU_STATUS
+    lulog *dbg = s->ctx->log;
+    data *d = s->d;
+    circulant *c = s->cell;
+    gsl_vector *xy = &s->coeff.vector, *g_xy = &s->neg_force.vector;
+    gsl_vector *x = &s->cell_x.vector, *g = &s->cell_g.vector;
+    gsl_vector *dx = &s->cell_dx.vector, *x1 = &s->cell_x1.vector;
+    int iter = 0;
+    double e, e1, slope;
+
+    d->to_rim = &xy_coeff_to_rim;
+    d->load = NULL;
+    gsl_vector_set_zero(x);
+    gsl_vector_set_zero(xy);
+
+    calculate_data(xy, d);
+    log_energy(s, "Before relax cell", NULL, NULL);
+
+    trace_start(s->trace);
+    d->n_f = d->n_df = 0;
+
+    for (; iter < MAX_ITER_OUTER && !stop_early(s); ++iter) {
+        cell_to_xy(c, x, xy);
+        energy_and_neg_force(xy, d, &e, g_xy);
+        xy_to_cell(c, g_xy, g);
+        double gradient = vec_len(g_xy);
+        trace_iteration(s->trace, method_names[method_cell], iter, e, gradient, NAN);
+        if (!iter || !(iter & (iter - 1))) ludebug(dbg, "Gradient %g (%d)", gradient, iter);
+        if (gsl_multimin_test_gradient(g_xy, 1e-4) == GSL_SUCCESS) {
+            luinfo(dbg, "Minimum energy: %g", e);
+            break;
+        }
+        if (stalled(s, iter, e, gradient)) break;
+        // the block is the stiffness of one cell; the whole wheel is m
+        // times that
+        calculate_data(xy, d);
+        slope = 0;
+        if (!calculate_circulant(d, c) && !cell_solve(c, g, dx)) {
+            gsl_vector_scale(dx, -1.0 / c->repeats);
+            gsl_blas_ddot(dx, g, &slope);
+        }
+        if (slope >= 0) {
+            ludebug(dbg, "No descent direction at %d", iter);
+            break;
+        }
+        double alpha = 1;
+        for (; alpha > MIN_NEWTON_STEP; alpha *= 0.5) {
+            gsl_vector_memcpy(x1, x);
+            gsl_blas_daxpy(alpha, dx, x1);
+            cell_to_xy(c, x1, xy);
+            e1 = energy(xy, d);
+            if (e1 <= e + 1e-4 * alpha * slope) break;
+        }
+        if (alpha <= MIN_NEWTON_STEP) {
+            luwarn(dbg, "Cannot progress");
+            break;
+        }
+        gsl_vector_memcpy(x, x1);
+    }
+
+    trace_end(s->trace, iter, d->n_f, d->n_df);
+    cell_to_xy(c, x, xy);
+    calculate_data(xy, d);
+    log_energy(s, "After relax cell", &s->energy, &s->force);
+    update_rim(dbg, xy, d, s->wheel);
+
+    LU_NO_CLEANUP
+}
+
+// sweeps of red-black gauss-seidel until the gradient is small (or
+// stalls).  f evaluations in the trace are local evaluations scaled to
+// whole-wheel equivalents, and df evaluations are sweeps.
+int relax_gs(solver *s, load *load) {
+
+    LU_STATUS
+    lulog *dbg = s->ctx->log;
+    wheel *w = s->wheel;
+    data *d = s->d;
+    red_black *rb = s->rb;
+    gsl_vector *x = &s->coeff.vector;
+    int iter = 0, n_colours = 2 + w->n_holes % 2;
+    double e = 0;
+
+    d->to_rim = &xy_coeff_to_rim;
+    d->load = load;
+    gsl_vector_set_zero(x);
+
+    calculate_data(x, d);
+    reset_incremental(d);
+    log_energy(s, "Before relax gs", NULL, NULL);
+
+    trace_start(s->trace);
+    LU_CHECK(start_red_black(dbg, rb))
+    ludebug(dbg, "Gauss-Seidel with %d threads", rb->n_started + 1);
+
+    for (; iter < MAX_ITER_OUTER && !stop_early(s); ++iter) {
+        for (int c = 0; c < n_colours; ++c) run_colour(rb, c);
+        sum_strain(d);
+        e = incremental_energy(d);
+        double gradient = 0;
+        for (int i = 0; i < w->n_holes; ++i) {
+            xy g = rim_neg_force(d, i);
+            gradient += dot(g, g);
+        }
+        gradient = sqrt(gradient);
+        trace_iteration(s->trace, method_names[method_gs], iter, e, gradient, NAN);
+        if (!iter || !(iter & (iter - 1))) ludebug(dbg, "Gradient %g (%d)", gradient, iter);
+        if (gradient < 1e-4) {
+            luinfo(dbg, "Minimum energy: %g", e);
+            break;
+        }
+        if (stalled(s, iter, e, gradient)) break;
+    }
+
+LU_CLEANUP
+    stop_red_black(rb);
+    long n_eval = 0;
+    for (int i = 0; i < rb->n_threads; ++i) n_eval += rb->n_eval[i];
+    trace_end(s->trace, iter, n_eval / w->n_holes, iter);
+    for (int i = 0; i < w->n_holes; ++i) {
+        gsl_vector_set(x, 2*i+X, d->offset[i].x);
+        gsl_vector_set(x, 2*i+Y, d->offset[i].y);
+    }
+    calculate_data(x, d);
+    log_energy(s, "After relax gs", &s->energy, &s->force);
+    update_rim(dbg, x, d, w);
+    LU_RETURN
+}
+
+// run the methods in the pipeline in turn, each until it converges or
+// stalls, until the force is small enough (or we have tried n times, or
+// run out of time).
+int relax(solver *s, load *l, int n) {
+    LU_STATUS
+    lulog *dbg = s->ctx->log;
+    wheel *w = s->wheel;
+    options *opts = s->opts;
+    double mass = l ? l->mass : 0;
+    int done = 0;
+    PROFILE_BEGIN(t);
+    refresh_data(s->d);
+    for (int i = 0; i < w->n_holes; ++i) s->start[i] = w->rim[i];
+    predict(s, l);
+    for (int i = 0; i < n; ++i) {
+        ludebug(dbg, "Relax %d/%d", i , n);
+        for (int j = 0; j < opts->n_pipeline && !done && !stop_early(s); ++j) {
+            method m = opts->pipeline[j];
+            switch (m) {
+            case method_nm:
+                LU_CHECK(relax_f_fourier(s, l))
+                break;
+            case method_newton:
+                LU_CHECK(relax_newton(s, l))
+                break;
+            case method_cell:
+                // only valid with no load; leave it to the next method
+                if (l) continue;
+                LU_CHECK(relax_cell(s))
+                break;
+            case method_gs:
+                LU_CHECK(relax_gs(s, l))
+                break;
+            case method_ml:
+                LU_CHECK(relax_f_multilevel(s, l))
+                break;
+            default:
+                LU_CHECK(relax_fdf_xy(s, m, l))
+            }
+            done = s->force <= MAX_FORCE;
+        }
+        if (done || stop_early(s)) break;
+    }
+    note_quality(s, done ? quality_converged : stop_quality(s));
+    // shift is measured from before any prediction, so is the full
+    // response to this load step
+    for (int i = 0; i < w->n_holes; ++i) s->shift[i] = sub(w->rim[i], s->start[i]);
+    s->prev_mass = s->mass;
+    s->mass = mass;
+LU_CLEANUP
+    PROFILE_END(t, probe_relax);
+    LU_RETURN
+}
+
+#define MAX_CORRECT 20
+
+
+void free_stiffness(stiffness *k) {
+    if (k) {
+        if (k->k && !k->shared) gsl_matrix_free(k->k);
+        if (k->perm && !k->shared) gsl_permutation_free(k->perm);
+        free_circulant(k->c);
+        if (k->r) gsl_vector_free(k->r);
+        if (k->du) gsl_vector_free(k->du);
+        free(k);
+    }
+}
+
+int alloc_stiffness(lulog *dbg, stiffness **k, wheel *w) {
+    LU_STATUS
+    int n = w->n_holes, period = 2 * w->n_offsets;
+    LU_ALLOC(dbg, *k, 1)
+    if (!(n % period) && n > period) {
+        LU_CHECK(alloc_circulant(dbg, &(*k)->c, w, 0))
+        LU_ASSERT((*k)->r = gsl_vector_alloc(2 * n), LU_ERR_MEM, dbg, "Cannot allocate vector")
+        LU_ASSERT((*k)->du = gsl_vector_alloc(2 * n), LU_ERR_MEM, dbg, "Cannot allocate vector")
+    }
+    LU_NO_CLEANUP
+}
+
+// factorise for the current data (after calculate_data()), falling back
+// to the dense matrix if the blocks are singular.
+int factorise_stiffness(lulog *dbg, data *d, stiffness *k) {
+    LU_STATUS
+    int n = d->wheel->n_holes, signum;
+    k->blocks = k->c && !calculate_circulant(d, k->c);
+    if (!k->blocks) {
+        if (!k->k) {
+            LU_ASSERT(k->k = gsl_matrix_alloc(2 * n, 2 * n), LU_ERR_MEM, dbg, "Cannot allocate matrix")
+            LU_ASSERT(k->perm = gsl_permutation_alloc(2 * n), LU_ERR_MEM, dbg, "Cannot allocate permutation")
+        }
+        calculate_hessian(d, k->k);
+        LU_ASSERT(!gsl_linalg_LU_decomp(k->k, k->perm, &signum), LU_ERR, dbg, "Cannot factorise stiffness")
+    }
+    LU_NO_CLEANUP
+}
+
+// the factorisation of from (which must not change while k is in use),
+// with separate workspace for stiffness_solve() on another thread.
+int share_stiffness(lulog *dbg, stiffness *from, wheel *w, stiffness **k) {
+    LU_STATUS
+    int n = w->n_holes;
+    LU_ALLOC(dbg, *k, 1)
+    (*k)->shared = 1;
+    (*k)->blocks = from->blocks;
+    (*k)->k = from->k;
+    (*k)->perm = from->perm;
+    if (from->blocks) {
+        LU_CHECK(share_circulant(dbg, from->c, &(*k)->c))
+        LU_ASSERT((*k)->r = gsl_vector_alloc(2 * n), LU_ERR_MEM, dbg, "Cannot allocate vector")
+        LU_ASSERT((*k)->du = gsl_vector_alloc(2 * n), LU_ERR_MEM, dbg, "Cannot allocate vector")
+    }
+    LU_NO_CLEANUP
+}
+
+// solve with the factorisation alone (no refinement), for newton
+// iterations that correct as they go.
+int stiffness_step(lulog *dbg, stiffness *k, const gsl_vector *f, gsl_vector *u) {
+    LU_STATUS
+    if (!k->blocks) {
+        LU_ASSERT(!gsl_linalg_LU_solve(k->k, k->perm, f, u), LU_ERR, dbg, "Stiffness is singular")
+    } else {
+        LU_ASSERT(!circulant_solve(k->c, f, u), LU_ERR, dbg, "Stiffness is singular")
+    }
+    LU_NO_CLEANUP
+}
+
+// solve K u = f.  the circulant approximation to K is corrected for any
+// asymmetry in the wheel by iterative refinement.
+int stiffness_solve(lulog *dbg, data *d, stiffness *k, const gsl_vector *f, gsl_vector *u) {
+    LU_STATUS
+    if (!k->blocks) {
+        LU_ASSERT(!gsl_linalg_LU_solve(k->k, k->perm, f, u), LU_ERR, dbg, "Stiffness is singular")
+    } else {
+        LU_ASSERT(!circulant_solve(k->c, f, u), LU_ERR, dbg, "Stiffness is singular")
+        double target = 1e-10 * vec_len(f);
+        int i = 0;
+        for (; i < MAX_CORRECT; ++i) {
+            hessian_times(d, u, k->r);
+            gsl_vector_scale(k->r, -1);
+            gsl_vector_add(k->r, f);
+            if (vec_len(k->r) <= target) break;
+            LU_ASSERT(!circulant_solve(k->c, k->r, k->du), LU_ERR, dbg, "Stiffness is singular")
+            gsl_vector_add(u, k->du);
+        }
+        LU_ASSERT(i < MAX_CORRECT, LU_ERR, dbg, "Block solution did not converge")
+    }
+    LU_NO_CLEANUP
+}
+
+#define TARGET_WOBBLE 3e-3
+#define DAMP_TRUE 0.5
+#define DAMP_TENSION 0.5
+
+double mean_radius(wheel *w) {
+    double r = 0;
+    for (int i = 0; i < w->n_holes; ++i) r += length(w->rim[i]);
+    return r / w->n_holes;
+}
+
+// average distance of the rim from round (mm)
+double radial_wobble(wheel *w) {
+    double r = mean_radius(w), wobble = 0;
+    for (int i = 0; i < w->n_holes; ++i) wobble += fabs(length(w->rim[i]) - r);
+    return wobble / w->n_holes;
+}
+
+int true_damped(solver *s) {
+
+    LU_STATUS
+    lulog *dbg = s->ctx->log;
+    wheel *w = s->wheel;
+    int trued = 0;
+    PROFILE_BEGIN(t);
+    start_phase(s, phase_true);
+
+    LU_CHECK(relax(s, NULL, MAX_ITER_INNER))
+    if (!s->opts->no_dump) LU_CHECK(dump_wheel(dbg, w, "untrue"))
+
+    while(!stop_early(s)) {
+
+        double r_target = mean_radius(w), wobble = radial_wobble(w), shift = 0;
+        luinfo(dbg, "Average radial wobble %gmm", wobble);
+        if ((trued = wobble <= TARGET_WOBBLE) || stop_early(s)) break;
+        for (int i = 0; i < w->n_holes; ++i) {
+            double l = length(w->rim[i]);
+            if (l > r_target) {
+                double excess = DAMP_TRUE * (l - r_target);
+                w->l_spoke[w->rim_to_hub[i]] -= excess;
+                shift += excess;
+            }
+        }
+        luinfo(dbg, "Total correction %gmm", shift);
+        LU_CHECK(relax(s, NULL, MAX_ITER_INNER));
+
+        double tension = 0;
+        for (int i = 0; i < w->n_holes; ++i) {
+            int j = w->rim_to_hub[i];
+            double l = length(sub(w->rim[i], w->hub[j]));
+            double l0 = w->l_spoke[j];
+            tension += w->e_spoke * (l - l0) / l0;
+        }
+        tension /= w->n_holes;
+        // df/dl = e/l0 so dl = df l0 / e
+        double error = tension - w->tension;
+        luinfo(dbg, "Tension excess is %g", error);
+        for (int i = 0; i < w->n_holes; ++i) {
+            // if tension is too large, correction is positive and spoke is extended
+            w->l_spoke[i] += DAMP_TENSION * w->l_spoke[i] * error / w->e_spoke;
+        }
+        LU_CHECK(relax(s, NULL, MAX_ITER_INNER));
+    }
+
+    if (!s->opts->no_dump) LU_CHECK(dump_wheel(dbg, w, "true"))
+    if (trued) {
+        luinfo(dbg, "True!");
+    } else {
+        note_quality(s, stop_quality(s));
+        luwarn(dbg, "Not true (%s)", quality_names[stop_quality(s)]);
+    }
+
+LU_CLEANUP
+    PROFILE_END(t, probe_true);
+    LU_RETURN
+}
+
+#define MAX_TRUE_NEWTON 20
+#define TARGET_TENSION 1e-3  // N
+
+// true by newton's method on the spoke lengths: the rim radius at every
+// hole should equal the mean (n-1 equations, since they sum to zero) and
+// the mean tension the target (1 equation).  the jacobian comes from the
+// linear response of the relaxed rim to each spoke length, via the
+// factorised stiffness.
+int true_newton(solver *s) {
+
+    LU_STATUS
+    lulog *dbg = s->ctx->log;
+    wheel *w = s->wheel;
+    data *d = s->d;
+    int n = w->n_holes, signum;
+    stiffness *k = NULL;
+    gsl_matrix *jac = NULL, *du = NULL;
+    gsl_vector *b = NULL, *f = NULL, *dl = NULL;
+    gsl_permutation *perm = NULL;
+    double *radius = NULL, *radial = NULL;
+    int trued = 0;
+    PROFILE_BEGIN(t);
+    start_phase(s, phase_true);
+
+    LU_CHECK(alloc_stiffness(dbg, &k, w))
+    LU_ASSERT(jac = gsl_matrix_alloc(n, n), LU_ERR_MEM, dbg, "Cannot allocate matrix")
+    LU_ASSERT(du = gsl_matrix_alloc(n, 2 * n), LU_ERR_MEM, dbg, "Cannot allocate matrix")
+    LU_ASSERT(b = gsl_vector_calloc(2 * n), LU_ERR_MEM, dbg, "Cannot allocate vector")
+    LU_ASSERT(f = gsl_vector_alloc(n), LU_ERR_MEM, dbg, "Cannot allocate vector")
+    LU_ASSERT(dl = gsl_vector_alloc(n), LU_ERR_MEM, dbg, "Cannot allocate vector")
+    LU_ASSERT(perm = gsl_permutation_alloc(n), LU_ERR_MEM, dbg, "Cannot allocate permutation")
+    LU_ALLOC(dbg, radius, n)
+    LU_ALLOC(dbg, radial, 2 * n)
+
+    LU_CHECK(relax(s, NULL, MAX_ITER_INNER))
+    if (!s->opts->no_dump) LU_CHECK(dump_wheel(dbg, w, "untrue"))
+
+    for (int iter = 0; !stop_early(s); ++iter) {
+
+        refresh_data(d);
+        d->to_rim = &xy_coeff_to_rim;
+        d->load = NULL;
+        gsl_vector_set_zero(&s->coeff.vector);
+        calculate_data(&s->coeff.vector, d);
+
+        // residuals (rim order)
+        double r_target = 0, tension = 0, wobble = 0;
+        for (int i = 0; i < n; ++i) {
+            radius[i] = sqrt(d->rim_x[i] * d->rim_x[i] + d->rim_y[i] * d->rim_y[i]);
+            radial[2*i+X] = d->rim_x[i] / radius[i];
+            radial[2*i+Y] = d->rim_y[i] / radius[i];
+            r_target += radius[i] / n;
+            tension += w->e_spoke * d->spoke_extn[i] * d->inv_l_spoke[i] / n;
+        }
+        for (int i = 0; i < n; ++i) wobble += fabs(radius[i] - r_target) / n;
+        double error = tension - w->tension;
+        luinfo(dbg, "Newton truing %d: average radial wobble %gmm, tension excess %gN", iter, wobble, error);
+        if ((trued = wobble <= TARGET_WOBBLE && fabs(error) <= TARGET_TENSION) || stop_early(s)) break;
+        LU_ASSERT(iter < MAX_TRUE_NEWTON, LU_ERR, dbg, "Newton truing did not converge")
+        for (int i = 0; i < n - 1; ++i) gsl_vector_set(f, i, r_target - radius[i]);
+        gsl_vector_set(f, n - 1, -error);
+
+        // rim response to each spoke: lengthening spoke j reduces its pull
+        // on rim j by k d / l0^2
+        LU_CHECK(factorise_stiffness(dbg, d, k))
+        for (int j = 0; j < n; ++j) {
+            gsl_vector_view u = gsl_matrix_row(du, j);
+            double c = 1e-3 * w->e_spoke * d->inv_l_spoke[j] * d->inv_l_spoke[j];
+            gsl_vector_set_zero(b);
+            gsl_vector_set(b, 2*j+X, c * d->spoke_x[j]);
+            gsl_vector_set(b, 2*j+Y, c * d->spoke_y[j]);
+            LU_CHECK(stiffness_solve(dbg, d, k, b, &u.vector))
+            double mean = 0, dtension = -w->e_spoke * d->spoke_len[j] * d->inv_l_spoke[j] * d->inv_l_spoke[j];
+            for (int i = 0; i < n; ++i) {
+                double ux = gsl_vector_get(&u.vector, 2*i+X), uy = gsl_vector_get(&u.vector, 2*i+Y);
+                double dr = radial[2*i+X] * ux + radial[2*i+Y] * uy;
+                gsl_matrix_set(jac, i, j, dr);
+                mean += dr / n;
+                dtension += w->e_spoke * d->inv_l_spoke[i] * (d->spoke_x[i] * ux + d->spoke_y[i] * uy) / d->spoke_len[i];
+            }
+            for (int i = 0; i < n - 1; ++i) gsl_matrix_set(jac, i, j, gsl_matrix_get(jac, i, j) - mean);
+            gsl_matrix_set(jac, n - 1, j, dtension / n);
+        }
+        LU_ASSERT(!gsl_linalg_LU_decomp(jac, perm, &signum) && !gsl_linalg_LU_solve(jac, perm, f, dl),
+                LU_ERR, dbg, "Truing jacobian is singular")
+
+        // new lengths, and the linear prediction of the rim as a start
+        for (int j = 0; j < n; ++j) {
+            double l = gsl_vector_get(dl, j);
+            w->l_spoke[w->rim_to_hub[j]] += l;
+            for (int i = 0; i < n; ++i) {
+                w->rim[i].x += l * gsl_matrix_get(du, j, 2*i+X);
+                w->rim[i].y += l * gsl_matrix_get(du, j, 2*i+Y);
+            }
+        }
+        LU_CHECK(relax(s, NULL, MAX_ITER_INNER))
+    }
+
+    if (!s->opts->no_dump) LU_CHECK(dump_wheel(dbg, w, "true"))
+    if (trued) {
+        luinfo(dbg, "True!");
+    } else {
+        note_quality(s, stop_quality(s));
+        luwarn(dbg, "Not true (%s)", quality_names[stop_quality(s)]);
+    }
+
+LU_CLEANUP
+    free_stiffness(k);
+    if (jac) gsl_matrix_free(jac);
+    if (du) gsl_matrix_free(du);
+    if (b) gsl_vector_free(b);
+    if (f) gsl_vector_free(f);
+    if (dl) gsl_vector_free(dl);
+    if (perm) gsl_permutation_free(perm);
+    free(radius);
+    free(radial);
+    PROFILE_END(t, probe_true);
+    LU_RETURN
+}
+
+int lace(lulog *dbg, wheel *wheel) {
+
+    LU_STATUS
+    double *tension = NULL;
+    PROFILE_BEGIN(t);
+
+    LU_ALLOC(dbg, tension, wheel->n_holes);
+
+    for (int i_hub = 0; i_hub < wheel->n_holes; i_hub += 2) {
+        int offset = wheel->offset[(i_hub / 2) % wheel->n_offsets];
+        int i_rim = (i_hub + 2 * offset + wheel->n_holes) % wheel->n_holes;
+        wheel->hub_to_rim[i_hub] = i_rim;
+        wheel->rim_to_hub[i_rim] = i_hub;
+        wheel->hub[i_hub] = xy_on_circle(wheel->r_hub, i_hub, wheel->n_holes);
+        wheel->rim[i_rim] = xy_on_circle(wheel->r_rim, i_rim, wheel->n_holes);
+    }
+    for (int i = 0; i < wheel->n_holes; i += 2) {
+        int offset = wheel->offset[(i / 2) % wheel->n_offsets];
+        int i_hub = (i + 2 * wheel->align + 1 + wheel->n_holes) % wheel->n_holes;
+        int i_rim = (i + 2 * (offset + wheel->align) + 1 + wheel->n_holes) % wheel->n_holes;
+        wheel->hub_to_rim[i_hub] = i_rim;
+        wheel->rim_to_hub[i_rim] = i_hub;
+        wheel->hub[i_hub] = xy_on_circle(wheel->r_hub, i_hub, wheel->n_holes);
+        wheel->rim[i_rim] = xy_on_circle(wheel->r_rim, i_rim, wheel->n_holes);
+    }
+
+    // set lengths so that all have desired radial tension
+    for (int i_hub = 0; i_hub < wheel->n_holes; ++i_hub) {
+        int i_rim = wheel->hub_to_rim[i_hub];
+        double l = length(sub(wheel->hub[i_hub], wheel->rim[i_rim]));
+        double theta = angle_to_rim(wheel, i_hub);
+        double strain = wheel->tension / (sin(theta) * wheel->e_spoke);
+        wheel->l_spoke[i_hub] = l * (1 - strain);
+    }
+
+LU_CLEANUP
+    free(tension);
+    PROFILE_END(t, probe_lace);
+    LU_RETURN
+}
+
+int deform(solver *s, load *l) {
+
+    LU_STATUS
+    lulog *dbg = s->ctx->log;
+    wheel *wheel = s->wheel;
+    PROFILE_BEGIN(t);
+    start_phase(s, phase_deform);
+
+    for (int i = 0; i < N_DEFORM; ++i) {
+        l->mass = 10 * (float)(i + 1) / N_DEFORM;
+        ludebug(dbg,"Mass %gkg", l->mass);
+        // end is current even if the budget is spent before relaxing
+        l->start = l->end = wheel->rim[l->i_rim];
+        LU_CHECK(relax(s, l, MAX_ITER_INNER))
+    }
+
+LU_CLEANUP
+    PROFILE_END(t, probe_deform);
+    LU_RETURN
+}
+
+int alloc_load(lulog *dbg, load **l) {
+
+    LU_STATUS
+
+    LU_ALLOC(dbg, *l, 1)
+    (*l)->g_norm.x = 1/sqrt(2);
+    (*l)->g_norm.y = -1/sqrt(2);
+//    (*l)->g_norm.x = 0;
+//    (*l)->g_norm.y = -1;
+    (*l)->i_rim = 0;
+
+    LU_NO_CLEANUP
+}
+
+// values (indexed by param) replace the defaults from make_wheel() if
+// given.
+int laced_wheel_params(lulog *dbg, const char *pattern, const double *values, wheel **wheel) {
+
+    LU_STATUS
+    int offsets[PACKED_MAX_LENGTH], length = 0, holes = 0, padding;
+    char type;
+
+    luinfo(dbg, "Pattern '%s'", pattern);
+    LU_CHECK(decode(dbg, pattern, NULL, offsets, &length, &type, &padding))
+    LU_ASSERT(strchr("AB", type), LU_ERR, dbg, "Only symmetric types supported")
+    LU_CHECK(dump_pattern(dbg, offsets, length))
+    LU_CHECK(rim_size(dbg, length, &holes))
+    LU_CHECK(make_wheel(dbg, offsets, length, holes, padding, type, pattern, wheel))
+    if (values) {
+        (*wheel)->r_hub = values[param_r_hub];
+        (*wheel)->r_rim = values[param_r_rim];
+        (*wheel)->l_chord = 2 * (*wheel)->r_rim * sin(M_PI / (*wheel)->n_holes);  // as make_wheel()
+        (*wheel)->tension = values[param_tension];
+        (*wheel)->e_spoke = values[param_e_spoke];
+        (*wheel)->e_rim = values[param_e_rim];
+    }
+    LU_CHECK(lace(dbg, *wheel))
+
+    LU_NO_CLEANUP
+}
+
+int laced_wheel(lulog *dbg, const char *pattern, wheel **wheel) {
+    return laced_wheel_params(dbg, pattern, NULL, wheel);
+}
+
+// a laced and trued wheel, with its solver.  if there is a cache then a
+// wheel with the same parameters is read from there, or saved there after
+// truing.  the laced wheel is dumped unless opts->no_dump.
+int trued_wheel(struct spokes *ctx, const char *pattern, options *opts, wheel **w, solver **s) {
+
+    LU_STATUS
+    lulog *dbg = ctx->log;
+    lustr path = {0};
+    wheel *cached = NULL;
+
+    LU_CHECK(laced_wheel(dbg, pattern, w))
+    if (!opts->no_dump) LU_CHECK(dump_wheel(dbg, *w, "laced"))
+    if (opts->cache) {
+        LU_ASSERT(!mkdir(opts->cache, 0755) || errno == EEXIST, LU_ERR_IO, dbg,
+                "Cannot create cache %s", opts->cache)
+        LU_CHECK(cache_path(dbg, opts->cache, *w, &path))
+        if (!access(path.c, R_OK)) {
+            // a bad entry is re-trued (and replaced)
+            if (read_wheel(dbg, path.c, &cached)) {
+                luwarn(dbg, "Ignoring unreadable %s", path.c);
+            } else if (same_wheel(*w, cached)) {
+                luinfo(dbg, "Trued wheel from %s", path.c);
+                free_wheel(*w);
+                *w = cached;
+                cached = NULL;
+                LU_CHECK(alloc_solver(ctx, s, *w, opts))
+                goto exit;
+            } else {
+                luwarn(dbg, "Cache collision for %s", path.c);
+            }
+        }
+    }
+    LU_CHECK(alloc_solver(ctx, s, *w, opts))
+    LU_CHECK(opts->newton_true ? true_newton(*s) : true_damped(*s))
+    // only a wheel that is really true is worth keeping
+    if (opts->cache && (*s)->quality[phase_true] == quality_converged) {
+        LU_CHECK(write_wheel(dbg, *w, path.c))
+        luinfo(dbg, "Trued wheel saved to %s", path.c);
+    }
+
+LU_CLEANUP
+    free_wheel(cached);
+    status = lustr_free(&path, status);
+    LU_RETURN
+}
@@ -0,0 +1,296 @@
+
+#ifndef SPOKES_SOLVER_H
+#define SPOKES_SOLVER_H
+
+#include <time.h>
+
+#include "gsl/gsl_vector.h"
+#include "gsl/gsl_matrix.h"
+#include "gsl/gsl_permutation.h"
+#include "gsl/gsl_multimin.h"
+
+#include "lu/log.h"
+
+#include "wheel.h"
+#include "kernel.h"
+#include "trace.h"
+
+// relaxation of a laced wheel (rim hinged at each hole), truing and
+// deformation under load.  all state is in the solver, and the context it
+// was allocated with, so separate wheels can be solved in separate
+// threads.
+
+struct spokes;
+
+#define X 0
+#define Y 1
+#define G 9.8
+
+#define MAX_ITER_OUTER 10000
+#define MAX_ITER_INNER 10000
+#define MAX_FORCE 1
+#define STALL_WINDOW 100
+#define MIN_NEWTON_STEP 1e-10
+
+// minimisation methods that can be combined in a pipeline
+typedef enum {
+    method_sd,             // steepest descent (xy)
+    method_cg,             // conjugate gradient, fletcher-reeves (xy)
+    method_bfgs2,          // vector bfgs2 (xy)
+    method_newton,         // newton with analytic hessian (xy)
+    method_nm,             // nelder-mead simplex (fourier)
+    method_cell,           // newton for one periodic cell (unloaded only)
+    method_gs,             // red-black gauss-seidel, one node at a time (xy)
+    method_ml,             // nelder-mead on increasing numbers of modes (fourier)
+    n_method
+} method;
+
+extern const char *method_names[n_method];
+
+// physical parameters that can be swept
+typedef enum {
+    param_r_hub,
+    param_r_rim,
+    param_tension,
+    param_e_spoke,
+    param_e_rim,
+    n_param
+} param;
+
+extern const char *param_names[n_param];
+
+// how a relaxation (or truing, or a phase) finished.  later values are
+// worse, and a phase keeps the worst of its relaxations.
+typedef enum {
+    quality_converged,     // force (or wobble) within target
+    quality_unconverged,   // stalled or MAX_ITER_*
+    quality_budget,        // out of time (best so far kept)
+    quality_interrupted,   // cancelled (see spokes_cancel())
+    n_quality
+} quality;
+
+extern const char *quality_names[n_quality];
+
+#define MAX_PIPELINE 8
+#define MAX_LEVELS 16
+#define DEFAULT_PIPELINE "sd,nm"
+
+// command line options (also the settings for the library)
+typedef struct {
+    const char *trace;     // path for csv trace of relaxations
+    method pipeline[MAX_PIPELINE];  // methods used (in order) by relax()
+    int n_pipeline;
+    int newton_true;       // true_newton() rather than true_damped()
+    const char *cache;     // directory for trued wheels (optional)
+    int no_dump;           // don't write wheel snapshots while truing
+    int pages;             // deformation plots as one multi-page pdf
+    int n_threads;         // for sweeps and gs (0 for the default)
+    double budget[n_phase];  // seconds for each phase (0 for no limit)
+    double total_budget;   // seconds for the whole run (0 for no limit)
+} options;
+
+struct data;
+
+typedef void coeff_to_rim(const gsl_vector *coeff, struct data *d);
+
+typedef struct data {
+    wheel *wheel;          // wheel in initial state
+    coeff_to_rim *to_rim;  // mapping from coeff to rim
+    const kernels *k;      // implementation of inner loops
+    xy *offset;            // radial and tangential offsets from coeffs
+    xy *rim;               // rim locations (wheel->rim + offset)
+    // the rest are structure of arrays, indexed by rim hole
+    double *rim_x;         // copy of rim
+    double *rim_y;
+    double *hub_x;         // hub end of spoke (see refresh_data())
+    double *hub_y;
+    double *l_spoke;       // unloaded spoke length (see refresh_data())
+    double *l_chord;       // unloaded rim segment length (constant)
+    double *inv_l_spoke;   // 1 / l_spoke
+    double *inv_l_chord;   // 1 / l_chord
+    double *spoke_x;       // vector along spoke (rim - hub)
+    double *spoke_y;
+    double *spoke_len;
+    double *spoke_extn;    // extension of spoke (mm)
+    double *chord_x;       // vector along rim segment (after - before)
+    double *chord_y;
+    double *chord_len;
+    double *chord_extn;    // extension of rim segment (mm)
+    double *spoke_fx;      // negative force on rim from spoke
+    double *spoke_fy;
+    double *chord_fx;      // negative force on after from rim segment
+    double *chord_fy;
+    double *spoke_e;       // energy of each spoke (see reset_incremental())
+    double *chord_e;       // energy of each rim segment
+    double strain;         // sum of the above
+    int n_moves;           // move_rim() calls since strain was summed
+    load *load;            // additional load
+    long n_f;              // calls to energy (and gradient) since reset
+    long n_df;
+} data;
+
+#define N_DATA_XY 2        // number of xy arrays in data
+#define N_DATA_DOUBLE 22   // number of double arrays in data
+
+// the unloaded wheel repeats every 2L holes (L the pattern length), so in
+// coordinates that rotate with each hole the stiffness is block-circulant
+// and a dft over the repeat index splits it into independent (complex)
+// 4L x 4L blocks, one per wavenumber.  this is exact for the laced wheel
+// and close for a trued one (which is used as a newton step, so need not
+// be exact).  with a single wavenumber (k = 0) the block is the stiffness
+// of one periodic cell.
+typedef struct {
+    int n;
+    int period;                   // holes per repeat
+    int repeats;
+    int wavenumbers;              // blocks built (repeats, or 1 for a cell)
+    gsl_matrix_complex **block;   // per wavenumber, lu decomposed
+    gsl_permutation **perm;
+    gsl_vector_complex *rhs;
+    gsl_vector_complex **modes;   // per wavenumber, solution
+    int shared;                   // blocks belong to another (see share_circulant())
+} circulant;
+
+// a single block of memory, carved into the arrays used by a solver, so
+// that nothing is allocated once relaxation starts.
+typedef struct {
+    double *base;
+    size_t size;   // in doubles
+    size_t used;
+} arena;
+
+#define ARENA_XY(a, n) ((xy*)arena_take(a, 2 * (n)))
+#define ARENA_DOUBLE(a, n) ((double*)arena_take(a, n))
+
+struct red_black;
+
+// persistent state for the relaxations of a single wheel.  everything
+// (apart from gsl's internal state for the minimizers) lives in one
+// arena sized from n_holes, and the displacement from the last relax()
+// is kept so that the next can start from a prediction (linear
+// extrapolation in load) rather than from the previous solution.
+typedef struct {
+    struct spokes *ctx;                // log and cancellation
+    wheel *wheel;                      // wheel being relaxed (rim updated)
+    options *opts;
+    arena arena;                       // storage for all arrays below
+    data *d;                           // shared by all minimizers
+    gsl_vector_view coeff;             // initial coefficients
+    gsl_vector_view step;              // initial simplex size
+    gsl_vector_view neg_force;         // for log_energy()
+    gsl_multimin_fdfminimizer *fdf[n_method];  // for gradient methods in pipeline
+    gsl_multimin_fminimizer *f;        // if nelder-mead in pipeline
+    gsl_multimin_fminimizer *f_level[MAX_LEVELS];  // multilevel, by number of modes
+    int level_modes[MAX_LEVELS];
+    int n_levels;
+    gsl_matrix_view hessian;           // these for newton only
+    gsl_permutation *perm;
+    circulant *circ;                   // unloaded newton (if the pattern repeats)
+    circulant *cell;                   // periodic cell stiffness
+    gsl_vector_view cell_x, cell_g, cell_dx, cell_x1;
+    struct red_black *rb;              // gauss-seidel threads
+    gsl_vector_view gradient;
+    gsl_vector_view dx;
+    gsl_vector_view x1;
+    xy *start;                         // rim at start of relax()
+    xy *shift;                         // displacement over last relax()
+    double mass;                       // load for last relax()
+    double prev_mass;                  // load for relax() before that
+    double energy;                     // result of last relaxation
+    double force;
+    double stall_energy[STALL_WINDOW]; // recent history (see stalled())
+    double stall_gradient[STALL_WINDOW];
+    trace *trace;                      // convergence telemetry
+    struct timespec created;           // start of the run (for budgets)
+    double deadline;                   // seconds after created (see start_phase())
+    int timed_out;                     // deadline passed in this phase
+    quality quality[n_phase];          // worst relaxation in each phase
+} solver;
+
+// the factorised tangent stiffness of the unloaded wheel, for linear
+// response.  in blocks if the pattern repeats, otherwise dense.
+typedef struct {
+    gsl_matrix *k;
+    gsl_permutation *perm;
+    circulant *c;
+    gsl_vector *r, *du;  // for refinement
+    int blocks;          // last factorisation used c
+    int shared;          // k and perm belong to another (see share_stiffness())
+} stiffness;
+
+double angle_to_rim(wheel *wheel, int i_hub);
+
+// energy and force
+void fourier_coeff_to_rim(const gsl_vector *coeff, data *d);
+void xy_coeff_to_rim(const gsl_vector *coeff, data *d);
+void refresh_data(data *d);
+void calculate_data(const gsl_vector *coeff, data *d);
+double load_energy(load *l);
+void add_load_neg_force(load *l, gsl_vector *neg_force);
+void calculate_energy(data *d, double *energy);
+double sum_force(wheel *w, gsl_vector *neg_force);
+void calculate_neg_force(data *d, gsl_vector *neg_force);
+void calculate_hessian(data *d, gsl_matrix *hessian);
+void hessian_times(data *d, const gsl_vector *u, gsl_vector *ku);
+double energy(const gsl_vector *coeff, void *params);
+void neg_force(const gsl_vector *coeff, void *params, gsl_vector *neg_force);
+void staged_energy_and_neg_force(const gsl_vector *coeff, data *d, double *energy, gsl_vector *neg_force);
+void fused_energy_and_neg_force(const gsl_vector *coeff, data *d, double *energy, gsl_vector *neg_force);
+void energy_and_neg_force(const gsl_vector *coeff, void *params, double *energy, gsl_vector *neg_force);
+double vec_len(const gsl_vector *v);
+void spoke_tensions(data *d, double *tension);
+
+// incremental updates (one node or spoke at a time)
+void reset_incremental(data *d);
+double update_node(data *d, int i, xy p);
+void move_rim(data *d, int i, xy p);
+void set_l_spoke(data *d, int i, double l_spoke);
+double incremental_energy(data *d);
+xy rim_neg_force(data *d, int i);
+double node_energy_at(data *d, int i, xy p);
+
+// storage
+int alloc_arena(lulog *dbg, arena *a, size_t size);
+void *arena_take(arena *a, size_t n);
+int arena_data(lulog *dbg, arena *a, data **d, wheel *w, load *l);
+int arena_vector(lulog *dbg, arena *a, gsl_vector_view *v, size_t n);
+
+// stiffness
+void free_circulant(circulant *c);
+int alloc_circulant(lulog *dbg, circulant **c, wheel *w, int cell);
+int share_circulant(lulog *dbg, circulant *from, circulant **c);
+int calculate_circulant(data *d, circulant *c);
+int circulant_solve(circulant *c, const gsl_vector *f, gsl_vector *u);
+void free_stiffness(stiffness *k);
+int alloc_stiffness(lulog *dbg, stiffness **k, wheel *w);
+int factorise_stiffness(lulog *dbg, data *d, stiffness *k);
+int share_stiffness(lulog *dbg, stiffness *from, wheel *w, stiffness **k);
+int stiffness_step(lulog *dbg, stiffness *k, const gsl_vector *f, gsl_vector *u);
+int stiffness_solve(lulog *dbg, data *d, stiffness *k, const gsl_vector *f, gsl_vector *u);
+
+// solver
+int parse_pipeline(lulog *dbg, const char *spec, options *opts);
+int parse_budget(lulog *dbg, const char *spec, options *opts);
+int in_pipeline(options *opts, method m);
+int alloc_solver(struct spokes *ctx, solver **s, wheel *w, options *opts);
+void free_solver(solver *s);
+void start_phase(solver *s, phase p);
+int stop_early(solver *s);
+quality run_quality(solver *s);
+int hit_budget(solver *s);
+void quality_summary(solver *s);
+int relax(solver *s, load *l, int n);
+double mean_radius(wheel *w);
+double radial_wobble(wheel *w);
+int true_damped(solver *s);
+int true_newton(solver *s);
+int deform(solver *s, load *l);
+
+// wheels
+int lace(lulog *dbg, wheel *wheel);
+int alloc_load(lulog *dbg, load **l);
+int laced_wheel_params(lulog *dbg, const char *pattern, const double *values, wheel **wheel);
+int laced_wheel(lulog *dbg, const char *pattern, wheel **wheel);
+int trued_wheel(struct spokes *ctx, const char *pattern, options *opts, wheel **w, solver **s);
+
+#endif
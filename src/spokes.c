@@ -0,0 +1,114 @@
+
+#include <stdlib.h>
+
+#include "gsl/gsl_errno.h"
+#include "gsl/gsl_rng.h"
+
+#include "lu/status.h"
+#include "lu/log.h"
+#include "lu/dynamic_memory.h"
+
+#include "codec.h"
+#include "lib.h"
+#include "wheel.h"
+#include "solver.h"
+#include "spokes.h"
+
+
+int spokes_alloc(lulog *log, unsigned long seed, spokes **ctx) {
+    LU_STATUS
+    lulog *dbg = log;
+    LU_ALLOC(dbg, *ctx, 1)
+    (*ctx)->log = log;
+    LU_ASSERT((*ctx)->rng = gsl_rng_alloc(gsl_rng_mt19937), LU_ERR, dbg, "Could not create PRNG")
+    gsl_rng_set((*ctx)->rng, seed);
+    // process-wide, but idempotent; singular hessians are handled in
+    // relax_newton()
+    gsl_set_error_handler_off();
+    LU_NO_CLEANUP
+}
+
+int spokes_free(spokes *ctx, int prev_status) {
+    if (ctx) {
+        if (ctx->rng) gsl_rng_free(ctx->rng);
+        free(ctx);
+    }
+    return prev_status;
+}
+
+void spokes_cancel(spokes *ctx) {
+    ctx->cancel = 1;
+}
+
+int spokes_pattern(spokes *ctx, const char *pattern, int **offsets, int *length, char *type, int *padding) {
+    return unpack(ctx->log, pattern, offsets, length, type, padding);
+}
+
+int spokes_lace(spokes *ctx, const char *pattern, wheel **w) {
+    return laced_wheel(ctx->log, pattern, w);
+}
+
+int spokes_true(spokes *ctx, wheel *w, options *opts, quality *q) {
+    LU_STATUS
+    solver *s = NULL;
+    LU_CHECK(alloc_solver(ctx, &s, w, opts))
+    LU_CHECK(opts->newton_true ? true_newton(s) : true_damped(s))
+    if (q) *q = run_quality(s);
+LU_CLEANUP
+    free_solver(s);
+    LU_RETURN
+}
+
+int spokes_deform(spokes *ctx, wheel *w, options *opts, load *l, quality *q) {
+    LU_STATUS
+    solver *s = NULL;
+    LU_CHECK(alloc_solver(ctx, &s, w, opts))
+    LU_CHECK(deform(s, l))
+    if (q) *q = run_quality(s);
+LU_CLEANUP
+    free_solver(s);
+    LU_RETURN
+}
+
+int spokes_plot_pattern(spokes *ctx, const char *pattern, const char *path) {
+
+    LU_STATUS
+    lulog *dbg = ctx->log;
+    int offsets[PACKED_MAX_LENGTH], length = 0, holes = 0, nx = 0, ny = 0, padding;
+    char type;
+
+    luinfo(dbg, "Pattern '%s'", pattern);
+    LU_CHECK(decode(dbg, pattern, NULL, offsets, &length, &type, &padding))
+    LU_CHECK(dump_pattern(dbg, offsets, length))
+    LU_CHECK(rim_size(dbg, length, &holes))
+    LU_CHECK(plot_size(dbg, type, &nx, &ny))
+    LU_ASSERT(!draw_lacing(offsets, length, holes, nx, ny, padding, path), LU_ERR_IO, dbg, "Cannot write %s", path)
+
+    LU_NO_CLEANUP
+}
+
+int spokes_draw_pattern(spokes *ctx, const char *pattern, cairo_surface_t *surfaces[SPOKES_N_GROUPS],
+        cairo_surface_t **surface) {
+
+    LU_STATUS
+    lulog *dbg = ctx->log;
+    int offsets[PACKED_MAX_LENGTH], length = 0, holes = 0, nx = 0, ny = 0, padding;
+    char type;
+
+    LU_CHECK(decode(dbg, pattern, NULL, offsets, &length, &type, &padding))
+    LU_CHECK(rim_size(dbg, length, &holes))
+    LU_CHECK(plot_size(dbg, type, &nx, &ny))
+    *surface = surfaces[type - 'A'];
+    if (!*surface) {
+        *surface = surfaces[type - 'A'] = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, nx, ny);
+        LU_ASSERT(cairo_surface_status(*surface) == CAIRO_STATUS_SUCCESS, LU_ERR_MEM, dbg,
+                "Cannot create %dx%d surface", nx, ny)
+    }
+    draw_lacing_surface(*surface, offsets, length, holes, padding, lacing_default.batch);
+
+    LU_NO_CLEANUP
+}
+
+int spokes_plot_deform(spokes *ctx, wheel *original, wheel *deformed, load *l, options *opts, const char *prefix) {
+    return plot_multi_deform(ctx->log, original, deformed, l, prefix, opts->pages);
+}
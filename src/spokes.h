@@ -0,0 +1,59 @@
+
+#ifndef SPOKES_SPOKES_H
+#define SPOKES_SPOKES_H
+
+#include <signal.h>
+
+#include "gsl/gsl_rng.h"
+
+#include "lu/log.h"
+
+#include "codec.h"
+#include "wheel.h"
+#include "solver.h"
+
+// the library interface.  what used to be global in the programs (the
+// log, the random number generator and the flag set on sigint) is in a
+// context.  there is no other shared state, so calls can run in parallel
+// threads with one context each, or share a context if they do not use
+// its rng.  spokes_cancel() is safe from any thread or a signal handler.
+
+typedef struct spokes {
+    lulog *log;                    // not owned
+    gsl_rng *rng;
+    volatile sig_atomic_t cancel;  // stop iterating (keeping the best so far)
+} spokes;
+
+int spokes_alloc(lulog *log, unsigned long seed, spokes **ctx);
+int spokes_free(spokes *ctx, int prev_status);
+void spokes_cancel(spokes *ctx);
+
+// patterns (see lib.c for the syntax)
+int spokes_pattern(spokes *ctx, const char *pattern, int **offsets, int *length, char *type, int *padding);
+// called with each pattern found (eg "2,-3B1", and packed) and its
+// full length
+typedef int spokes_found(void *user, const char *pattern, packed p, int length);
+int spokes_search(spokes *ctx, spokes_found *found, void *user);
+// every pattern from spokes_search(), to find the name for any pattern
+// that laces the same way (see index.c).  read only once built.
+typedef struct spokes_index spokes_index;
+int spokes_index_alloc(spokes *ctx, spokes_index **idx);
+int spokes_index_free(spokes_index *idx, int prev_status);
+int spokes_canonical(spokes *ctx, spokes_index *idx, const char *pattern, const char **canonical);
+
+// wheels.  spokes_true() and spokes_deform() use a solver of their own,
+// configured by opts, and return the worst quality of any phase.
+int spokes_lace(spokes *ctx, const char *pattern, wheel **w);
+int spokes_true(spokes *ctx, wheel *w, options *opts, quality *q);
+int spokes_deform(spokes *ctx, wheel *w, options *opts, load *l, quality *q);
+
+// rendering
+int spokes_plot_pattern(spokes *ctx, const char *pattern, const char *path);
+// draw into one of the caller's surfaces (indexed by group, A to C, and
+// created when first needed), which is returned in surface.
+#define SPOKES_N_GROUPS 3
+int spokes_draw_pattern(spokes *ctx, const char *pattern, cairo_surface_t *surfaces[SPOKES_N_GROUPS],
+        cairo_surface_t **surface);
+int spokes_plot_deform(spokes *ctx, wheel *original, wheel *deformed, load *l, options *opts, const char *prefix);
+
+#endif
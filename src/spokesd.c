@@ -0,0 +1,578 @@
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "lu/status.h"
+#include "lu/log.h"
+#include "lu/strings.h"
+#include "lu/dynamic_memory.h"
+
+#include "lib.h"
+#include "wheel.h"
+#include "solver.h"
+#include "spokes.h"
+#include "profile.h"
+#include "daemon.h"
+
+
+// a daemon that answers queries over a unix domain socket (see daemon.h
+// for the protocol), so that tools need not start a program (and redo
+// all the work) for each pattern.  the pattern index is built once, each
+// worker keeps its own cairo surfaces, trued wheels can be cached on disk
+// (-c, as stress), and recent responses are kept in memory.
+
+#define DEFAULT_ENTRIES 1024
+#define MAX_QUEUE 64
+#define POLL_MS 200
+
+// the program's log, and the context for the listener (whose cancel
+// flag is set on sigint)
+lulog *dbg = NULL;
+spokes *ctx = NULL;
+
+
+// recent responses, by request line, least recently used last
+
+typedef struct entry {
+    char *key;
+    char *body;
+    size_t length;
+    int status;
+    struct entry *prev, *next;  // in use order
+    struct entry *chain;        // in hash bucket
+} entry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int n, max;
+    int n_buckets;
+    entry **buckets;
+    entry *first, *last;
+    long hits, misses;
+} lru;
+
+static uint64_t hash(const char *key) {
+    uint64_t h = 14695981039346656037ULL;  // fnv-1a
+    while (*key) h = (h ^ (unsigned char)*key++) * 1099511628211ULL;
+    return h;
+}
+
+static void unlink_entry(lru *c, entry *e) {
+    if (e->prev) e->prev->next = e->next; else c->first = e->next;
+    if (e->next) e->next->prev = e->prev; else c->last = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void push_entry(lru *c, entry *e) {
+    e->next = c->first;
+    if (c->first) c->first->prev = e;
+    c->first = e;
+    if (!c->last) c->last = e;
+}
+
+static void free_entry(entry *e) {
+    if (e) {
+        free(e->key);
+        free(e->body);
+        free(e);
+    }
+}
+
+static void drop_entry(lru *c, entry *e) {
+    entry **p = &c->buckets[hash(e->key) % c->n_buckets];
+    while (*p != e) p = &(*p)->chain;
+    *p = e->chain;
+    unlink_entry(c, e);
+    free_entry(e);
+    c->n--;
+}
+
+int alloc_lru(lulog *dbg, lru *c, int max) {
+    LU_STATUS
+    c->max = max;
+    c->n_buckets = 2 * max + 1;
+    LU_ALLOC(dbg, c->buckets, c->n_buckets)
+    LU_ASSERT(!pthread_mutex_init(&c->lock, NULL), LU_ERR, dbg, "Cannot create lock")
+    LU_NO_CLEANUP
+}
+
+void free_lru(lru *c) {
+    if (c->buckets) {
+        while (c->first) drop_entry(c, c->first);
+        free(c->buckets);
+        pthread_mutex_destroy(&c->lock);
+    }
+}
+
+// copy any response for key into body (the caller's buffer)
+int lru_get(lulog *dbg, lru *c, const char *key, lustr *body, int *found, int *result) {
+    LU_STATUS
+    entry *e;
+    pthread_mutex_lock(&c->lock);
+    for (e = c->buckets[hash(key) % c->n_buckets]; e && strcmp(e->key, key); e = e->chain);
+    *found = !!e;
+    body->idx = 0;
+    if (e) {
+        unlink_entry(c, e);
+        push_entry(c, e);
+        c->hits++;
+        *result = e->status;
+        if (body->mem < e->length + 1) {
+            LU_ASSERT(body->c = realloc(body->c, e->length + 1), LU_ERR_MEM, dbg, "Cannot grow response")
+            body->mem = e->length + 1;
+        }
+        memcpy(body->c, e->body, e->length);
+        body->idx = e->length;
+    } else {
+        c->misses++;
+    }
+LU_CLEANUP
+    pthread_mutex_unlock(&c->lock);
+    LU_RETURN
+}
+
+// a second worker may compute the same response; the later replaces
+// the earlier
+int lru_put(lulog *dbg, lru *c, const char *key, const lustr *body, int result) {
+    LU_STATUS
+    entry *e = NULL, **bucket;
+    LU_ALLOC(dbg, e, 1)
+    LU_ALLOC(dbg, e->key, strlen(key) + 1)
+    strcpy(e->key, key);
+    if (body->idx) {
+        LU_ALLOC(dbg, e->body, body->idx)
+        memcpy(e->body, body->c, body->idx);
+    }
+    e->length = body->idx;
+    e->status = result;
+    pthread_mutex_lock(&c->lock);
+    bucket = &c->buckets[hash(key) % c->n_buckets];
+    for (entry *old = *bucket; old; old = old->chain) {
+        if (!strcmp(old->key, key)) {drop_entry(c, old); break;}
+    }
+    e->chain = *bucket;
+    *bucket = e;
+    push_entry(c, e);
+    if (++c->n > c->max) drop_entry(c, c->last);
+    pthread_mutex_unlock(&c->lock);
+    e = NULL;
+LU_CLEANUP
+    free_entry(e);
+    LU_RETURN
+}
+
+
+// connections waiting for a worker
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    int fd[MAX_QUEUE];
+    int head, n;
+    int closed;
+} queue;
+
+// -1 once the queue is closed
+static int next_connection(queue *q) {
+    int fd = -1;
+    pthread_mutex_lock(&q->lock);
+    while (!q->n && !q->closed) pthread_cond_wait(&q->ready, &q->lock);
+    if (q->n) {
+        fd = q->fd[q->head];
+        q->head = (q->head + 1) % MAX_QUEUE;
+        q->n--;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return fd;
+}
+
+// false if full (the caller closes the connection)
+static int add_connection(queue *q, int fd) {
+    int added = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->n < MAX_QUEUE) {
+        q->fd[(q->head + q->n++) % MAX_QUEUE] = fd;
+        added = 1;
+        pthread_cond_signal(&q->ready);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return added;
+}
+
+static void close_queue(queue *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->ready);
+    pthread_mutex_unlock(&q->lock);
+}
+
+
+// the state shared by all workers (read only, apart from the locked
+// cache and queue)
+
+typedef struct {
+    spokes_index *idx;
+    options opts;
+    lru cache;
+    queue queue;
+} server;
+
+// each worker has its own context (so its own rng and log use) and
+// surfaces, and a buffer for responses
+typedef struct {
+    server *srv;
+    spokes *ctx;
+    cairo_surface_t *surfaces[SPOKES_N_GROUPS];
+    lustr body;
+    lustr in;
+} worker;
+
+static cairo_status_t append_png(void *closure, const unsigned char *data, unsigned int length) {
+    lustr *body = closure;
+    if (body->mem < body->idx + length + 1) {
+        size_t mem = 2 * (body->idx + length) + 1;
+        char *c = realloc(body->c, mem);
+        if (!c) return CAIRO_STATUS_NO_MEMORY;
+        body->c = c;
+        body->mem = mem;
+    }
+    memcpy(body->c + body->idx, data, length);
+    body->idx += length;
+    return CAIRO_STATUS_SUCCESS;
+}
+
+static int canon(worker *wk, const char *pattern) {
+    LU_STATUS
+    const char *canonical = NULL;
+    LU_CHECK(spokes_canonical(wk->ctx, wk->srv->idx, pattern, &canonical))
+    LU_CHECK(lustr_sprintf(wk->ctx->log, &wk->body, "%s", canonical))
+    LU_NO_CLEANUP
+}
+
+static int plot(worker *wk, const char *pattern) {
+    LU_STATUS
+    lulog *dbg = wk->ctx->log;
+    cairo_surface_t *surface = NULL;
+    LU_CHECK(spokes_draw_pattern(wk->ctx, pattern, wk->surfaces, &surface))
+    PROFILE_BEGIN(t);
+    LU_ASSERT(cairo_surface_write_to_png_stream(surface, append_png, &wk->body) == CAIRO_STATUS_SUCCESS,
+            LU_ERR_MEM, dbg, "Cannot encode png")
+LU_CLEANUP
+    PROFILE_END(t, probe_png);
+    LU_RETURN
+}
+
+// the numbers in the stress sweep csv, as "name value" lines
+static int stress(worker *wk, const char *pattern) {
+
+    LU_STATUS
+    lulog *dbg = wk->ctx->log;
+    wheel *w = NULL;
+    solver *s = NULL;
+    load *l = NULL;
+    double *tension = NULL, lowest = INFINITY, highest = -INFINITY;
+
+    LU_CHECK(trued_wheel(wk->ctx, pattern, &wk->srv->opts, &w, &s))
+    LU_CHECK(alloc_load(dbg, &l))
+    LU_CHECK(deform(s, l))
+    s->d->to_rim = &xy_coeff_to_rim;
+    s->d->load = l;
+    gsl_vector_set_zero(&s->coeff.vector);
+    calculate_data(&s->coeff.vector, s->d);
+    LU_ALLOC(dbg, tension, w->n_holes)
+    spoke_tensions(s->d, tension);
+    for (int i = 0; i < w->n_holes; ++i) {
+        lowest = fmin(lowest, tension[i]);
+        highest = fmax(highest, tension[i]);
+    }
+    LU_CHECK(lustr_sprintf(dbg, &wk->body,
+            "energy %g\nmin_tension %g\nmax_tension %g\ndeflection %g\nquality %s\n",
+            s->energy, lowest, highest, length(sub(l->end, l->start)), quality_names[run_quality(s)]))
+
+LU_CLEANUP
+    free(tension);
+    free(l);
+    free_solver(s);
+    free_wheel(w);
+    LU_RETURN
+}
+
+static int write_all(int fd, const char *data, size_t n) {
+    while (n) {
+        ssize_t done = write(fd, data, n);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) return LU_ERR_IO;
+        data += done;
+        n -= done;
+    }
+    return LU_OK;
+}
+
+// a single request line; errors in the request go to the client, but
+// errors writing to the client end the connection
+static int respond(worker *wk, int fd, const char *line) {
+
+    LU_STATUS
+    lulog *dbg = wk->ctx->log;
+    char command[16], pattern[MAX_PATTERN], header[64];
+    int result = LU_OK, found = 0, n;
+
+    wk->body.idx = 0;
+    if (sscanf(line, "%15s %" MAX_PATTERN_FORMAT "s", command, pattern) != 2) {
+        luwarn(dbg, "Bad request '%s'", line);
+        result = LU_ERR_ARG;
+    } else {
+        LU_CHECK(lru_get(dbg, &wk->srv->cache, line, &wk->body, &found, &result))
+    }
+    if (!found && !result) {
+        if (!strcmp(command, "canon")) {
+            result = canon(wk, pattern);
+        } else if (!strcmp(command, "plot")) {
+            result = plot(wk, pattern);
+        } else if (!strcmp(command, "stress")) {
+            result = stress(wk, pattern);
+        } else {
+            luwarn(dbg, "Unknown command '%s'", command);
+            result = LU_ERR_ARG;
+        }
+        if (result) wk->body.idx = 0;
+        // errors (perhaps transient, like memory) and interrupted results
+        // are not worth keeping
+        if (!result && !wk->ctx->cancel) LU_CHECK(lru_put(dbg, &wk->srv->cache, line, &wk->body, result))
+    }
+
+    n = sprintf(header, "%d %zu\n", result, wk->body.idx);
+    LU_CHECK(write_all(fd, header, n))
+    LU_CHECK(write_all(fd, wk->body.c, wk->body.idx))
+
+    LU_NO_CLEANUP
+}
+
+// any number of requests, until the client closes the connection
+static int serve(worker *wk, int fd) {
+
+    LU_STATUS
+    lulog *dbg = wk->ctx->log;
+    lustr *in = &wk->in;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    char *end;
+    ssize_t n;
+
+    in->idx = 0;
+    while (!ctx->cancel) {
+        while (!(end = memchr(in->c, '\n', in->idx))) {
+            LU_ASSERT(in->idx < MAX_REQUEST, LU_ERR_ARG, dbg, "Request too long")
+            // an idle client must not hold up shutdown
+            if (ctx->cancel) goto exit;
+            if (poll(&pfd, 1, POLL_MS) <= 0) continue;
+            n = read(fd, in->c + in->idx, MAX_REQUEST - in->idx);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) goto exit;  // closed by client
+            in->idx += n;
+        }
+        *end = '\0';
+        if (end > in->c && end[-1] == '\r') end[-1] = '\0';
+        LU_CHECK(respond(wk, fd, in->c))
+        in->idx -= end + 1 - in->c;
+        memmove(in->c, end + 1, in->idx);
+    }
+
+    LU_NO_CLEANUP
+}
+
+static void *serve_worker(void *arg) {
+    worker *wk = arg;
+    int fd;
+    while ((fd = next_connection(&wk->srv->queue)) >= 0) {
+        if (serve(wk, fd)) ludebug(wk->ctx->log, "Connection closed after error");
+        close(fd);
+    }
+    return NULL;
+}
+
+static int listen_on(const char *path, int *fd) {
+
+    LU_STATUS
+    struct sockaddr_un addr = {0};
+
+    LU_ASSERT(strlen(path) < sizeof(addr.sun_path), LU_ERR_ARG, dbg, "Socket path %s too long", path)
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    LU_ASSERT((*fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0, LU_ERR_IO, dbg, "Cannot create socket")
+    unlink(path);
+    LU_ASSERT(!bind(*fd, (struct sockaddr*)&addr, sizeof(addr)), LU_ERR_IO, dbg, "Cannot bind %s", path)
+    LU_ASSERT(!listen(*fd, MAX_QUEUE), LU_ERR_IO, dbg, "Cannot listen on %s", path)
+    luinfo(dbg, "Listening on %s", path);
+
+    LU_NO_CLEANUP
+}
+
+int run(const char *path, options *opts, int n_threads, int n_entries) {
+
+    LU_STATUS
+    server srv = {0};
+    worker *workers = NULL;
+    pthread_t *threads = NULL;
+    int listener = -1, n_started = 0, queued = 0;
+    struct pollfd pfd;
+
+    srv.opts = *opts;
+    srv.opts.trace = NULL;
+    srv.opts.no_dump = 1;
+    // parallel across requests, not within them
+    srv.opts.n_threads = 1;
+    if (n_threads <= 0) n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    LU_CHECK(spokes_index_alloc(ctx, &srv.idx))
+    LU_CHECK(alloc_lru(dbg, &srv.cache, n_entries))
+    LU_ASSERT(!pthread_mutex_init(&srv.queue.lock, NULL), LU_ERR, dbg, "Cannot create lock")
+    LU_ASSERT(!pthread_cond_init(&srv.queue.ready, NULL), LU_ERR, dbg, "Cannot create condition")
+    queued = 1;
+    LU_CHECK(listen_on(path, &listener))
+
+    LU_ALLOC(dbg, workers, n_threads)
+    LU_ALLOC(dbg, threads, n_threads)
+    for (; n_started < n_threads; ++n_started) {
+        worker *wk = &workers[n_started];
+        wk->srv = &srv;
+        LU_CHECK(spokes_alloc(dbg, n_started, &wk->ctx))
+        LU_ALLOC(dbg, wk->in.c, MAX_REQUEST + 1)
+        wk->in.mem = MAX_REQUEST + 1;
+        LU_ASSERT(!pthread_create(&threads[n_started], NULL, serve_worker, wk), LU_ERR, dbg, "Cannot start thread")
+    }
+    luinfo(dbg, "%d workers; caching up to %d responses", n_threads, n_entries);
+
+    pfd.fd = listener;
+    pfd.events = POLLIN;
+    while (!ctx->cancel) {
+        if (poll(&pfd, 1, POLL_MS) <= 0) continue;
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) continue;
+        if (!add_connection(&srv.queue, fd)) {
+            luwarn(dbg, "Too many waiting connections");
+            close(fd);
+        }
+    }
+
+LU_CLEANUP
+    if (queued) close_queue(&srv.queue);
+    // stop every worker before waiting for any
+    for (int i = 0; i < n_started; ++i) spokes_cancel(workers[i].ctx);
+    for (int i = 0; i < n_started; ++i) pthread_join(threads[i], NULL);
+    if (workers) {
+        for (int i = 0; i < n_threads; ++i) {
+            for (int j = 0; j < SPOKES_N_GROUPS; ++j) {
+                if (workers[i].surfaces[j]) cairo_surface_destroy(workers[i].surfaces[j]);
+            }
+            status = lustr_free(&workers[i].body, status);
+            status = lustr_free(&workers[i].in, status);
+            status = spokes_free(workers[i].ctx, status);
+        }
+    }
+    if (srv.cache.buckets) luinfo(dbg, "%ld responses from cache, %ld calculated", srv.cache.hits, srv.cache.misses);
+    if (listener >= 0) {
+        close(listener);
+        unlink(path);
+    }
+    while (srv.queue.n) close(next_connection(&srv.queue));
+    if (queued) {
+        pthread_cond_destroy(&srv.queue.ready);
+        pthread_mutex_destroy(&srv.queue.lock);
+    }
+    free_lru(&srv.cache);
+    status = spokes_index_free(srv.idx, status);
+    free(workers);
+    free(threads);
+    LU_RETURN
+}
+
+void new_handler(int sig) {
+    luwarn(dbg, "Handler called with %d", sig);
+    spokes_cancel(ctx);
+}
+
+int set_handler() {
+    LU_STATUS
+    LU_ASSERT(!signal(SIGINT, &new_handler), LU_ERR, dbg, "Could not set handler")
+    LU_ASSERT(!signal(SIGTERM, &new_handler), LU_ERR, dbg, "Could not set handler")
+    signal(SIGPIPE, SIG_IGN);  // clients that go away are seen by write()
+    luinfo(dbg, "Handler set");
+    LU_NO_CLEANUP
+}
+
+void usage(const char *progname) {
+    luinfo(dbg, "Answer queries for patterns, plots and stresses on a unix socket");
+    luinfo(dbg, "%s -h           display this message", progname);
+    luinfo(dbg, "%s [options]    serve on %s until interrupted", progname, DEFAULT_SOCKET);
+    luinfo(dbg, "requests are lines 'canon pattern', 'plot pattern' or 'stress pattern'");
+    luinfo(dbg, "options:");
+    luinfo(dbg, "  -S path       unix socket path");
+    luinfo(dbg, "  -j n          worker threads (default all cpus)");
+    luinfo(dbg, "  -e n          responses kept in memory (default %d)", DEFAULT_ENTRIES);
+    luinfo(dbg, "  -s sd,nm      solver pipeline (from %s; default %s)", "sd,cg,bfgs2,newton,nm,cell,gs,ml", DEFAULT_PIPELINE);
+    luinfo(dbg, "  -n            true by newton's method on spoke lengths");
+    luinfo(dbg, "  -c dir        cache trued wheels in dir");
+    luinfo(dbg, "  -T spec       time budget in seconds, per request or per phase (as stress)");
+    luinfo(dbg, "  --profile file.json  time each phase, over all workers, until shutdown");
+}
+
+int main(int argc, char** argv) {
+
+    LU_STATUS
+    int c, help = 0, n_threads = 0, n_entries = DEFAULT_ENTRIES;
+    const char *path = DEFAULT_SOCKET, *budget = NULL, *pipeline = DEFAULT_PIPELINE, *profile = NULL;
+    options opts = {0};
+
+    lulog_mkstderr(&dbg, lulog_level_info);
+    LU_CHECK(profile_args(dbg, &argc, argv, &profile))
+    while ((c = getopt(argc, argv, "hnS:j:e:s:c:T:")) != -1) {
+        switch (c) {
+        case 'S':
+            path = optarg;
+            break;
+        case 'j':
+            n_threads = atoi(optarg);
+            break;
+        case 'e':
+            n_entries = atoi(optarg);
+            break;
+        case 's':
+            pipeline = optarg;
+            break;
+        case 'n':
+            opts.newton_true = 1;
+            break;
+        case 'c':
+            opts.cache = optarg;
+            break;
+        case 'T':
+            budget = optarg;
+            break;
+        default:
+            help = 1;
+        }
+    }
+    if (help || optind != argc || n_entries < 1) {
+        usage(argv[0]);
+    } else {
+        LU_CHECK(spokes_alloc(dbg, 0, &ctx))
+        LU_CHECK(set_handler())
+        LU_CHECK(parse_pipeline(dbg, pipeline, &opts))
+        if (budget) LU_CHECK(parse_budget(dbg, budget, &opts))
+        LU_CHECK(run(path, &opts, n_threads, n_entries))
+    }
+
+LU_CLEANUP
+    status = spokes_free(ctx, status);
+    status = profile_write(dbg, profile, status);
+    if (dbg) status = dbg->free(&dbg, status);
+    return status;
+}
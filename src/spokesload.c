@@ -0,0 +1,253 @@
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "gsl/gsl_sort.h"
+#include "gsl/gsl_statistics.h"
+
+#include "lu/status.h"
+#include "lu/log.h"
+#include "lu/dynamic_memory.h"
+
+#include "trace.h"
+#include "daemon.h"
+
+
+// load generator for spokesd.  each connection (a thread) sends its
+// share of the requests, cycling through the commands and patterns, and
+// waits for each response before sending the next.
+
+#define DEFAULT_CONNECTIONS 4
+#define DEFAULT_REQUESTS 1000
+#define DEFAULT_COMMANDS "canon,plot"
+
+lulog *dbg = NULL;
+
+typedef struct {
+    const char *path;
+    int n_commands;
+    char **commands;
+    int n_patterns;
+    char **patterns;
+    int n_requests;        // total, over all connections
+    int n_connections;
+    double *latency;       // seconds, by request
+    int n_errors;          // non-zero status from spokesd
+    pthread_mutex_t lock;
+    int status;
+} load_test;
+
+typedef struct {
+    load_test *t;
+    int id;
+} connection;
+
+static int connect_to(const char *path, int *fd) {
+
+    LU_STATUS
+    struct sockaddr_un addr = {0};
+
+    LU_ASSERT(strlen(path) < sizeof(addr.sun_path), LU_ERR_ARG, dbg, "Socket path %s too long", path)
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    LU_ASSERT((*fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0, LU_ERR_IO, dbg, "Cannot create socket")
+    LU_ASSERT(!connect(*fd, (struct sockaddr*)&addr, sizeof(addr)), LU_ERR_IO, dbg, "Cannot connect to %s", path)
+
+    LU_NO_CLEANUP
+}
+
+static int write_all(int fd, const char *data, size_t n) {
+    while (n) {
+        ssize_t done = write(fd, data, n);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) return LU_ERR_IO;
+        data += done;
+        n -= done;
+    }
+    return LU_OK;
+}
+
+// read the header, then discard the body
+static int read_response(int fd, int *result) {
+
+    LU_STATUS
+    char header[64], buffer[4096];
+    size_t n = 0, length;
+    ssize_t got;
+
+    do {
+        LU_ASSERT(n < sizeof(header) - 1, LU_ERR_IO, dbg, "Bad response header")
+        got = read(fd, header + n, 1);
+        LU_ASSERT(got == 1, LU_ERR_IO, dbg, "Connection closed by spokesd")
+    } while (header[n++] != '\n');
+    header[n] = '\0';
+    LU_ASSERT(sscanf(header, "%d %zu", result, &length) == 2, LU_ERR_IO, dbg, "Bad response header")
+    while (length) {
+        got = read(fd, buffer, length < sizeof(buffer) ? length : sizeof(buffer));
+        if (got < 0 && errno == EINTR) continue;
+        LU_ASSERT(got > 0, LU_ERR_IO, dbg, "Connection closed by spokesd")
+        length -= got;
+    }
+
+    LU_NO_CLEANUP
+}
+
+static void *connection_worker(void *arg) {
+
+    LU_STATUS
+    connection *c = arg;
+    load_test *t = c->t;
+    char request[MAX_REQUEST];
+    struct timespec start;
+    int fd = -1, result, n_errors = 0, n;
+
+    LU_CHECK(connect_to(t->path, &fd))
+    for (int i = c->id; i < t->n_requests; i += t->n_connections) {
+        n = snprintf(request, sizeof(request), "%s %s\n",
+                t->commands[i % t->n_commands], t->patterns[(i / t->n_commands) % t->n_patterns]);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        LU_CHECK(write_all(fd, request, n))
+        LU_CHECK(read_response(fd, &result))
+        t->latency[i] = elapsed(&start);
+        if (result) n_errors++;
+    }
+
+LU_CLEANUP
+    if (fd >= 0) close(fd);
+    pthread_mutex_lock(&t->lock);
+    t->n_errors += n_errors;
+    if (!t->status) t->status = status;
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+static int split(const char *spec, char ***parts, int *n) {
+
+    LU_STATUS
+    char *copy = NULL, *p;
+
+    LU_ALLOC(dbg, copy, strlen(spec) + 1)
+    strcpy(copy, spec);
+    *n = 1;
+    for (p = copy; *p; ++p) if (*p == ',') (*n)++;
+    LU_ALLOC(dbg, *parts, *n)
+    (*parts)[0] = copy;
+    for (int i = 1; i < *n; ++i) {
+        p = strchr((*parts)[i-1], ',');
+        *p = '\0';
+        (*parts)[i] = p + 1;
+    }
+    copy = NULL;
+
+LU_CLEANUP
+    free(copy);
+    LU_RETURN
+}
+
+int run(load_test *t) {
+
+    LU_STATUS
+    pthread_t *threads = NULL;
+    connection *connections = NULL;
+    struct timespec start;
+    int n_started = 0, locked = 0;
+    double seconds;
+
+    LU_ALLOC(dbg, t->latency, t->n_requests)
+    LU_ALLOC(dbg, threads, t->n_connections)
+    LU_ALLOC(dbg, connections, t->n_connections)
+    LU_ASSERT(!pthread_mutex_init(&t->lock, NULL), LU_ERR, dbg, "Cannot create lock")
+    locked = 1;
+
+    luinfo(dbg, "%d requests over %d connections to %s", t->n_requests, t->n_connections, t->path);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (; n_started < t->n_connections; ++n_started) {
+        connections[n_started].t = t;
+        connections[n_started].id = n_started;
+        LU_ASSERT(!pthread_create(&threads[n_started], NULL, connection_worker, &connections[n_started]),
+                LU_ERR, dbg, "Cannot start thread")
+    }
+
+LU_CLEANUP
+    for (int i = 0; i < n_started; ++i) pthread_join(threads[i], NULL);
+    seconds = elapsed(&start);
+    if (!status) status = t->status;
+    if (!status) {
+        gsl_sort(t->latency, 1, t->n_requests);
+        luinfo(dbg, "%d requests in %.3fs: %.1f requests/s; %d errors",
+                t->n_requests, seconds, t->n_requests / seconds, t->n_errors);
+        luinfo(dbg, "Latency (ms): p50 %.3f, p90 %.3f, p99 %.3f, max %.3f",
+                1e3 * gsl_stats_quantile_from_sorted_data(t->latency, 1, t->n_requests, 0.5),
+                1e3 * gsl_stats_quantile_from_sorted_data(t->latency, 1, t->n_requests, 0.9),
+                1e3 * gsl_stats_quantile_from_sorted_data(t->latency, 1, t->n_requests, 0.99),
+                1e3 * t->latency[t->n_requests - 1]);
+    }
+    if (locked) pthread_mutex_destroy(&t->lock);
+    free(threads);
+    free(connections);
+    free(t->latency);
+    LU_RETURN
+}
+
+void usage(const char *progname) {
+    luinfo(dbg, "Measure spokesd throughput and latency");
+    luinfo(dbg, "%s -h               display this message", progname);
+    luinfo(dbg, "%s [options] pattern..  send requests for the patterns", progname);
+    luinfo(dbg, "options:");
+    luinfo(dbg, "  -S path           unix socket path (default %s)", DEFAULT_SOCKET);
+    luinfo(dbg, "  -c n              connections (default %d)", DEFAULT_CONNECTIONS);
+    luinfo(dbg, "  -n n              requests (default %d)", DEFAULT_REQUESTS);
+    luinfo(dbg, "  -m canon,plot     commands, in turn (from canon,plot,stress; default %s)", DEFAULT_COMMANDS);
+}
+
+int main(int argc, char** argv) {
+
+    LU_STATUS
+    int c, help = 0;
+    const char *commands = DEFAULT_COMMANDS;
+    load_test t = {0};
+
+    t.path = DEFAULT_SOCKET;
+    t.n_connections = DEFAULT_CONNECTIONS;
+    t.n_requests = DEFAULT_REQUESTS;
+    lulog_mkstderr(&dbg, lulog_level_info);
+    while ((c = getopt(argc, argv, "hS:c:n:m:")) != -1) {
+        switch (c) {
+        case 'S':
+            t.path = optarg;
+            break;
+        case 'c':
+            t.n_connections = atoi(optarg);
+            break;
+        case 'n':
+            t.n_requests = atoi(optarg);
+            break;
+        case 'm':
+            commands = optarg;
+            break;
+        default:
+            help = 1;
+        }
+    }
+    if (help || optind == argc || t.n_connections < 1 || t.n_requests < 1) {
+        usage(argv[0]);
+    } else {
+        LU_CHECK(split(commands, &t.commands, &t.n_commands))
+        t.patterns = argv + optind;
+        t.n_patterns = argc - optind;
+        LU_CHECK(run(&t))
+    }
+
+LU_CLEANUP
+    if (t.commands) free(t.commands[0]);
+    free(t.commands);
+    if (dbg) status = dbg->free(&dbg, status);
+    return status;
+}
@@ -5,11 +5,23 @@
 #include <math.h>
 #include <signal.h>
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #include "gsl/gsl_multimin.h"
 #include "gsl/gsl_vector.h"
 #include "gsl/gsl_rng.h"
+#include "gsl/gsl_randist.h"
+#include "gsl/gsl_sort.h"
+#include "gsl/gsl_statistics.h"
 #include "gsl/gsl_min.h"
+#include "gsl/gsl_matrix.h"
+#include "gsl/gsl_linalg.h"
+#include "gsl/gsl_errno.h"
+#include "gsl/gsl_blas.h"
+#include "gsl/gsl_complex_math.h"
 
 #include "lu/status.h"
 #include "lu/log.h"
@@ -17,604 +29,1280 @@
 #include "lu/strings.h"
 #include "lu/dynamic_memory.h"
 
+#include "codec.h"
 #include "lib.h"
 #include "wheel.h"
-
+#include "kernel.h"
+#include "trace.h"
+#include "solver.h"
+#include "spokes.h"
+#include "profile.h"
+
+// the program's log, and the library context (rng and the flag set on
+// sigint)
 lulog *dbg = NULL;
-gsl_rng *rng = NULL;
-volatile int sig_exit = 0;
-
-#define X 0
-#define Y 1
-#define G 9.8
-
-#define MAX_ITER_OUTER 10000
-#define MAX_ITER_INNER 10000
-#define N_DEFORM 1
-#define MAX_SIZE 1e-8
-#define MAX_FORCE 1
-
-
-/*
- * this coded does finite element analysis of wheels using a very simple
- * physical model (described somewhere in an email or online post by jobst)
- * where the rim is "hinged" at each spoke hole.
- *
- * unfortunately, for two leading two following, that model leads to a
- * non-physical solution, where the rim folds back on itself.  also, the
- * code below is extremely slow to converge - perhaps because i don't
- * know how best to propagate forces around the rim when not in
- * equilibrium.
- *
- * so i am not developing this further.
- */
-
-
-struct data;
-
-typedef void coeff_to_rim(const gsl_vector *coeff, struct data *d);
-
-typedef struct data {
-    wheel *wheel;          // wheel in initial state
-    coeff_to_rim *to_rim;  // mapping from coeff to rim
-    xy *offset;            // radial and tangential offsets from coeffs
-    xy *rim;               // rim locations (wheel->rim + offset)
-    double *spoke_extn;    // extension of spoke (mm) (rim index)
-    xy *spoke;             // vector along spoke (rim - hub) (rim index)
-    double *chord_extn;    // extension of rim segment (mm)
-    xy *chord;             // vector along rim segment
-    load *load;            // additional load
-} data;
-
-double angle_to_rim(wheel *wheel, int i_hub) {
-    int i_rim = wheel->hub_to_rim[i_hub];
-    xy hub = wheel->hub[i_hub];
-    xy rim = wheel->rim[i_rim];
-    // angle of spoke relative to horizontal
-    double theta = atan2(rim.y - hub.y, rim.x - hub.x);
-    // angle of radius to horizontal
-    double psi = atan2(rim.y, rim.x);
-    // angle of spoke relative to tangent, where 0 = along rim anticlock,
-    // 90 = towards axle, 180 = along rim clock (but in radians...)
-    return M_PI / 2 - psi + theta;
-}
-
-double eval_fourier_coeff(int i, int j, int n, double a) {
-    double shift = a;
-    if (i) {
-        int n_cycles = (i + 1) / 2;  // i = 1,2 -> 1; i = n-1 -> n/2
-        double x = j / (float)n;  // 0-1
-        double y = 2 * M_PI * x * n_cycles;
-        if (i % 2) {
-            // when i = n-1 we are here with n_cycles = n/2
-            // and get 1,-1,1,-1... for j = 0...n-1
-            // eg j = 1, x = 1/n, y = pi
-            shift = a * cos(y);
-        } else {
-            shift = a * sin(y);
-        }
-    }
-//    ludebug(dbg, "Shift %g for coeff %d at rim %d/%d, coeff %g", shift, i, j, n, a);
-    return shift;
+spokes *ctx = NULL;
+
+#ifdef COUNT_ALLOC
+// count heap allocations (including those inside gsl) by interposing
+// on the glibc allocator.  enable with ./configure --enable-count-alloc
+extern void *__libc_malloc(size_t n);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t n);
+long n_alloc = 0;
+void *malloc(size_t n) {n_alloc++; return __libc_malloc(n);}
+void *calloc(size_t n, size_t size) {n_alloc++; return __libc_calloc(n, size);}
+void *realloc(void *p, size_t n) {n_alloc++; return __libc_realloc(p, n);}
+#endif
+
+
+int stress(const char *pattern, options *opts) {
+
+    LU_STATUS
+    char *path = NULL;
+    wheel *wheel = NULL, *original = NULL;
+    load *load = NULL;
+    solver *solver = NULL;
+
+#ifdef COUNT_ALLOC
+    long n_alloc_start = n_alloc;
+#endif
+    LU_CHECK(trued_wheel(ctx, pattern, opts, &wheel, &solver))
+#ifdef COUNT_ALLOC
+    long n_relax = solver->trace->relaxations[phase_lace] + solver->trace->relaxations[phase_true];
+    luinfo(dbg, "%ld heap allocations while lacing and truing (%ld relaxations, %.1f each)",
+            n_alloc - n_alloc_start, n_relax, (double) (n_alloc - n_alloc_start) / (n_relax ? n_relax : 1));
+#endif
+    LU_CHECK(copy_wheel(dbg, wheel, &original))
+    LU_CHECK(alloc_load(dbg, &load))
+#ifdef COUNT_ALLOC
+    n_alloc_start = n_alloc;
+#endif
+    LU_CHECK(deform(solver, load))
+#ifdef COUNT_ALLOC
+    n_relax = solver->trace->relaxations[phase_deform];
+    luinfo(dbg, "%ld heap allocations while deforming (%ld relaxations, %.1f each)",
+            n_alloc - n_alloc_start, n_relax, (double) (n_alloc - n_alloc_start) / (n_relax ? n_relax : 1));
+#endif
+    trace_summary(dbg, solver->trace);
+    quality_summary(solver);
+    luinfo(dbg, "%d of 1 runs hit the budget", hit_budget(solver));
+    LU_CHECK(plot_multi_deform(dbg, original, wheel, load, pattern, opts->pages))
+//    plot_wheel(original, path);
+
+LU_CLEANUP
+    free_solver(solver);
+    free_wheel(original);
+    free_wheel(wheel);
+    free(path);
+    free(load);
+    LU_RETURN
 }
 
-void fourier_coeff_to_rim(const gsl_vector *coeff, data *d) {
+#define ROLL_MASS 10  // kg, as deform()
+
+// linear response of the trued wheel to a 1N load at every hole, in x
+// and y, from a single factorisation of the tangent stiffness.  row 2j+X
+// (2j+Y) of displacement is the rim displacement (mm, rim order) for a
+// load at hole j in x (y); the same row of tension is the change in
+// spoke tension (N, rim order).
+typedef struct {
+    int n;
+    double *tension0;          // trued tension (rim order)
+    gsl_matrix *displacement;  // 2n x 2n
+    gsl_matrix *tension;       // 2n x n
+} influence;
+
+void free_influence(influence *inf) {
+    if (inf) {
+        free(inf->tension0);
+        if (inf->displacement) gsl_matrix_free(inf->displacement);
+        if (inf->tension) gsl_matrix_free(inf->tension);
+        free(inf);
+    }
+}
 
-    wheel *w = d->wheel;
+int calculate_influence(solver *s, influence **inf) {
 
-    for (int i = 0; i < w->n_holes; ++i) {
-        for (int j = 0; j < w->n_holes; ++j) {
-            d->offset[j].x += eval_fourier_coeff(i, j, w->n_holes, gsl_vector_get(coeff, 2*i+X));
-            d->offset[j].y += eval_fourier_coeff(i, j, w->n_holes, gsl_vector_get(coeff, 2*i+Y));
+    LU_STATUS
+    wheel *w = s->wheel;
+    data *d = s->d;
+    int n = w->n_holes;
+    stiffness *k = NULL;
+    gsl_vector *f = NULL;
+    struct timespec start;
+
+    LU_ALLOC(dbg, *inf, 1)
+    (*inf)->n = n;
+    LU_ALLOC(dbg, (*inf)->tension0, n)
+    LU_ASSERT((*inf)->displacement = gsl_matrix_alloc(2 * n, 2 * n), LU_ERR_MEM, dbg, "Cannot allocate matrix")
+    LU_ASSERT((*inf)->tension = gsl_matrix_alloc(2 * n, n), LU_ERR_MEM, dbg, "Cannot allocate matrix")
+    LU_ASSERT(f = gsl_vector_calloc(2 * n), LU_ERR_MEM, dbg, "Cannot allocate vector")
+    LU_CHECK(alloc_stiffness(dbg, &k, w))
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    refresh_data(d);
+    d->to_rim = &xy_coeff_to_rim;
+    d->load = NULL;
+    gsl_vector_set_zero(&s->coeff.vector);
+    calculate_data(&s->coeff.vector, d);
+    spoke_tensions(d, (*inf)->tension0);
+    LU_CHECK(factorise_stiffness(dbg, d, k))
+
+    for (int j = 0; j < 2 * n; ++j) {
+        // energy is in J with the rim in mm, so 1N is 1e-3
+        gsl_vector_view u = gsl_matrix_row((*inf)->displacement, j);
+        gsl_vector_set_basis(f, j);
+        gsl_vector_scale(f, 1e-3);
+        LU_CHECK(stiffness_solve(dbg, d, k, f, &u.vector))
+        // hub is fixed, so extension is displacement along the spoke
+        for (int i = 0; i < n; ++i) {
+            double dl = (d->spoke_x[i] * gsl_vector_get(&u.vector, 2*i+X)
+                    + d->spoke_y[i] * gsl_vector_get(&u.vector, 2*i+Y)) / d->spoke_len[i];
+            gsl_matrix_set((*inf)->tension, j, i, w->e_spoke * dl * d->inv_l_spoke[i]);
         }
     }
+    luinfo(dbg, "Influence matrix for %d loads (%s) in %.3fs", 2 * n,
+            k->blocks ? "circulant" : "dense", elapsed(&start));
 
-    for (int i = 0; i < w->n_holes; ++i) {
-        double dr = d->offset[i].x, dt = d->offset[i].y;
-        double theta = atan2(w->rim[i].y, w->rim[i].x);
-        d->rim[i].x = w->rim[i].x + dr * cos(theta) + dt * sin(theta);
-        d->rim[i].y = w->rim[i].y + dr * sin(theta) - dt * cos(theta);
-    }
+LU_CLEANUP
+    if (f) gsl_vector_free(f);
+    free_stiffness(k);
+    LU_RETURN
+}
 
+// unit load pushing the rim at hole i towards the hub (contact with the
+// road when hole i is at the bottom).
+xy radial_load(wheel *w, int i) {
+    return scalar_mult(-1, norm(w->rim[i]));
 }
 
-void xy_coeff_to_rim(const gsl_vector *coeff, data *d) {
+// tensions (rim order) for a radial load of mass kg at hole i, by
+// superposition.
+void roll_tensions(influence *inf, wheel *w, int i, double mass, double *tension) {
+    xy g = scalar_mult(mass * G, radial_load(w, i));
+    for (int j = 0; j < inf->n; ++j) {
+        tension[j] = inf->tension0[j] + g.x * gsl_matrix_get(inf->tension, 2*i+X, j)
+                + g.y * gsl_matrix_get(inf->tension, 2*i+Y, j);
+    }
+}
 
-    wheel *w = d->wheel;
+// spoke tension over a revolution, one row per position of the load,
+// written to pattern-roll.csv
+int write_roll(influence *inf, wheel *w, const char *pattern, double *min_tension) {
 
-    for (int i = 0; i < w->n_holes; ++i) {
-        d->offset[i].x = gsl_vector_get(coeff, 2*i+X);
-        d->offset[i].y = gsl_vector_get(coeff, 2*i+Y);
+    LU_STATUS
+    lustr path = {0};
+    FILE *csv = NULL;
+    double *tension = NULL;
+    int n = inf->n;
+    struct timespec start;
+
+    LU_ALLOC(dbg, tension, n)
+    LU_CHECK(lustr_sprintf(dbg, &path, "%s-roll.csv", pattern))
+    LU_CHECK(lufle_open(dbg, path.c, "w", &csv))
+    fprintf(csv, "load");
+    for (int j = 0; j < n; ++j) fprintf(csv, ",spoke%d", j);
+    fprintf(csv, "\n");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double lowest = INFINITY, highest = -INFINITY;
+    for (int i = 0; i < n; ++i) {
+        roll_tensions(inf, w, i, ROLL_MASS, tension);
+        min_tension[i] = INFINITY;
+        fprintf(csv, "%d", i);
+        for (int j = 0; j < n; ++j) {
+            fprintf(csv, ",%g", tension[j]);
+            min_tension[i] = fmin(min_tension[i], tension[j]);
+            highest = fmax(highest, tension[j]);
+        }
+        fprintf(csv, "\n");
+        lowest = fmin(lowest, min_tension[i]);
     }
+    luinfo(dbg, "Tension over revolution (%gkg) from %gN to %gN (%.3fms)",
+            (double)ROLL_MASS, lowest, highest, 1e3 * elapsed(&start));
+    luinfo(dbg, "Tension history: %s", path.c);
 
-    for (int i = 0; i < w->n_holes; ++i) {
-        d->rim[i] = add(w->rim[i], d->offset[i]);
+LU_CLEANUP
+    if (csv) fclose(csv);
+    free(tension);
+    status = lustr_free(&path, status);
+    LU_RETURN
+}
+
+// solve the full (nonlinear) problem for the n_refine load positions with
+// the lowest tension and compare with the linear prediction.
+int refine_roll(solver *s, influence *inf, double *min_tension, int n_refine) {
+
+    LU_STATUS
+    wheel *w = s->wheel;
+    int n = w->n_holes;
+    xy *trued = NULL;
+    double *linear = NULL, *tension = NULL;
+    load *l = NULL;
+
+    LU_ALLOC(dbg, trued, n)
+    LU_ALLOC(dbg, linear, n)
+    LU_ALLOC(dbg, tension, n)
+    LU_CHECK(alloc_load(dbg, &l))
+    for (int i = 0; i < n; ++i) trued[i] = w->rim[i];
+    start_phase(s, phase_deform);
+
+    for (int r = 0; r < n_refine && r < n && !stop_early(s); ++r) {
+        int worst = -1;
+        for (int i = 0; i < n; ++i) {
+            if (!isnan(min_tension[i]) && (worst < 0 || min_tension[i] < min_tension[worst])) worst = i;
+        }
+        min_tension[worst] = NAN;  // done
+        for (int i = 0; i < n; ++i) w->rim[i] = trued[i];
+        s->mass = s->prev_mass = 0;
+        l->i_rim = worst;
+        l->g_norm = radial_load(w, worst);
+        l->mass = ROLL_MASS;
+        l->start = w->rim[worst];
+        LU_CHECK(relax(s, l, MAX_ITER_INNER))
+        s->d->to_rim = &xy_coeff_to_rim;
+        gsl_vector_set_zero(&s->coeff.vector);
+        calculate_data(&s->coeff.vector, s->d);
+        spoke_tensions(s->d, tension);
+        roll_tensions(inf, w, worst, ROLL_MASS, linear);
+        double low = INFINITY, low_linear = INFINITY, error = 0;
+        for (int i = 0; i < n; ++i) {
+            low = fmin(low, tension[i]);
+            low_linear = fmin(low_linear, linear[i]);
+            error = fmax(error, fabs(tension[i] - linear[i]));
+        }
+        luinfo(dbg, "Load at %d: lowest tension %gN (linear %gN), largest difference %gN",
+                worst, low, low_linear, error);
     }
+    for (int i = 0; i < n; ++i) w->rim[i] = trued[i];
 
+LU_CLEANUP
+    free(trued);
+    free(linear);
+    free(tension);
+    free(l);
+    LU_RETURN
 }
 
+int roll(const char *pattern, options *opts, int n_refine) {
 
-void calculate_data(const gsl_vector *coeff, data *d) {
-
-    int i_before = (i_rim - 1 + w->n_holes) % w->n_holes;
-    int i_after = (i_rim + 1 + w->n_holes) % w->n_holes;
-    int i_hub = w->rim_to_hub[i_rim];
+    LU_STATUS
+    wheel *wheel = NULL;
+    solver *solver = NULL;
+    influence *inf = NULL;
+    double *min_tension = NULL;
+
+    LU_CHECK(trued_wheel(ctx, pattern, opts, &wheel, &solver))
+    LU_CHECK(calculate_influence(solver, &inf))
+    LU_ALLOC(dbg, min_tension, wheel->n_holes)
+    LU_CHECK(write_roll(inf, wheel, pattern, min_tension))
+    LU_CHECK(refine_roll(solver, inf, min_tension, n_refine))
+    trace_summary(dbg, solver->trace);
+    quality_summary(solver);
 
-    memset(d->offset, 0, w->n_holes * sizeof(*d->offset));
-    memset(d->rim, 0, w->n_holes * sizeof(*d->rim));
-    memset(d->spoke_extn, 0, w->n_holes * sizeof(*d->spoke_extn));
-    memset(d->spoke, 0, w->n_holes * sizeof(*d->spoke));
-    memset(d->chord_extn, 0, w->n_holes * sizeof(*d->chord_extn));
-    memset(d->chord, 0, w->n_holes * sizeof(*d->chord));
+LU_CLEANUP
+    free(min_tension);
+    free_influence(inf);
+    free_solver(solver);
+    free_wheel(wheel);
+    LU_RETURN
+}
 
-    d->to_rim(coeff, d);
+int describe_wheel(const char *path) {
+    LU_STATUS
+    wheel *wheel = NULL;
+    LU_CHECK(read_wheel(dbg, path, &wheel))
+    print_wheel(dbg, wheel, stdout);
+LU_CLEANUP
+    free_wheel(wheel);
+    LU_RETURN
+}
 
-    for (int i = 0; i < w->n_holes; ++i) {
-        d->spoke[i] = sub(d->rim[i], w->hub[w->rim_to_hub[i]]);
-        d->spoke_extn[i] = length(d->spoke[i]) - w->l_spoke[w->rim_to_hub[i]];
-//        ludebug(dbg, "Spoke %d extended by %gmm", i, d->spoke_extn[i]);
+// parameter sweeps.  each parameter takes n values from lo to hi and
+// every combination is solved (trued, then deformed as stress()) by a
+// pool of threads.  each point starts from the nearest point already
+// solved, if any, and results are written as they complete.
+
+typedef struct {
+    int done;
+    int index[n_param];  // position in the grid
+    double *l_ratio;     // trued / laced spoke length (hub order)
+    xy *offset;          // trued rim from nominal (rim order)
+} point;
+
+typedef struct {
+    const char *pattern;
+    options opts;
+    double lo[n_param], hi[n_param];
+    int n[n_param];
+    int n_holes;
+    int n_points;
+    int next;
+    point *points;
+    FILE *csv;
+    pthread_mutex_t lock;
+    int n_budget;        // points that hit their budget
+    int status;
+} sweep;
+
+// name=lo:hi:n, comma separated
+int parse_sweep(const char *spec, sweep *sw) {
+    LU_STATUS
+    const char *p = spec;
+    while (*p) {
+        size_t len = strcspn(p, "=");
+        int found = 0;
+        for (param i = 0; i < n_param && !found; ++i) {
+            if (strlen(param_names[i]) == len && !strncmp(p, param_names[i], len)) {
+                int used = 0;
+                LU_ASSERT(sscanf(p + len, "=%lf:%lf:%d%n", &sw->lo[i], &sw->hi[i], &sw->n[i], &used) == 3
+                        && sw->n[i] > 0, LU_ERR_ARG, dbg, "Bad range for %s in %s", param_names[i], spec)
+                p += len + used;
+                found = 1;
+            }
+        }
+        LU_ASSERT(found, LU_ERR_ARG, dbg, "Unknown parameter in %s", spec)
+        LU_ASSERT(!*p || *p == ',', LU_ERR_ARG, dbg, "Bad sweep %s", spec)
+        if (*p) p++;
     }
+    LU_NO_CLEANUP
+}
 
-    for (int after = 0; after < w ->n_holes; ++after) {
-        int before = (after - 1 + w->n_holes) % w->n_holes;
-        d->chord[after] = sub(d->rim[after], d->rim[before]);
-        d->chord_extn[after] = length(d->chord[after]) - w->l_chord;
-//        ludebug(dbg, "Chord %d extended by %gmm", after, d->chord_extn[after]);
+void sweep_params(sweep *sw, point *pt, double *values) {
+    for (param i = 0; i < n_param; ++i) {
+        values[i] = sw->n[i] > 1 ?
+                sw->lo[i] + (sw->hi[i] - sw->lo[i]) * pt->index[i] / (sw->n[i] - 1) : sw->lo[i];
     }
+}
 
-    if (d->load) {
-        d->load->end = d->rim[d->load->i_rim];
+// nearest solved point (in grid steps), or NULL.  called with lock held.
+point *nearest_point(sweep *sw, point *pt) {
+    point *best = NULL;
+    int best_distance = 0;
+    for (int i = 0; i < sw->n_points; ++i) {
+        if (sw->points[i].done) {
+            int distance = 0;
+            for (param j = 0; j < n_param; ++j) distance += abs(sw->points[i].index[j] - pt->index[j]);
+            if (!best || distance < best_distance) {
+                best = &sw->points[i];
+                best_distance = distance;
+            }
+        }
     }
-
-    return f;
+    return best;
 }
 
-double f_abs_force(double x, void *params) {
-
-    data *d = (data*)params;
-    wheel *w = d->wheel;
+int sweep_point(sweep *sw, point *pt, double *l_ratio, xy *offset, int warm) {
 
-    for (int i = 0; i < w->n_holes; ++i) {
-        double extn = d->spoke_extn[i];
-        // 1e-3 since mm
-        *energy += 1e-3 * w->e_spoke * extn * extn / (2 * w->l_spoke[w->rim_to_hub[i]]);
+    LU_STATUS
+    double values[n_param], *laced = NULL, *tension = NULL;
+    wheel *w = NULL;
+    solver *s = NULL;
+    load *l = NULL;
+    struct timespec start;
+    int n = sw->n_holes;
+
+    sweep_params(sw, pt, values);
+    LU_CHECK(laced_wheel_params(dbg, sw->pattern, values, &w))
+    LU_ALLOC(dbg, laced, n)
+    LU_ALLOC(dbg, tension, n)
+    for (int i = 0; i < n; ++i) laced[i] = w->l_spoke[i];
+    if (warm >= 0) {
+        for (int i = 0; i < n; ++i) {
+            w->l_spoke[i] *= l_ratio[i];
+            w->rim[i] = add(xy_on_circle(w->r_rim, i, n), offset[i]);
+        }
     }
-    for (int i = 0; i < w ->n_holes; ++i) {
-        double extn = d->chord_extn[i];
-        *energy += 1e-3 * w->e_rim * extn * extn / (2 * w->l_chord);
+
+    LU_CHECK(alloc_solver(ctx, &s, w, &sw->opts))
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    LU_CHECK(sw->opts.newton_true ? true_newton(s) : true_damped(s))
+    double t_true = elapsed(&start);
+    for (int i = 0; i < n; ++i) {
+        l_ratio[i] = w->l_spoke[i] / laced[i];
+        offset[i] = sub(w->rim[i], xy_on_circle(w->r_rim, i, n));
     }
-    if (l) {
-        xy disp = sub(l->end, l->start);
-        double s = dot(disp, l->g_norm);
-//        ludebug(dbg, "Load moved by %gmm (%g,%g)", s, disp.x, disp.y);
-        *energy -= s * l->mass * G * 1e-3;  // mm -> m
+
+    LU_CHECK(alloc_load(dbg, &l))
+    LU_CHECK(deform(s, l))
+    s->d->to_rim = &xy_coeff_to_rim;
+    s->d->load = l;
+    gsl_vector_set_zero(&s->coeff.vector);
+    calculate_data(&s->coeff.vector, s->d);
+    spoke_tensions(s->d, tension);
+    double lowest = INFINITY, highest = -INFINITY;
+    for (int i = 0; i < n; ++i) {
+        lowest = fmin(lowest, tension[i]);
+        highest = fmax(highest, tension[i]);
     }
-}
 
-double sum_force(wheel *w, gsl_vector *neg_force) {
-    double total = 0;
-    for (int i = 0; i < w->n_holes; ++i) {
-        double fx = gsl_vector_get(neg_force, 2*i+X), fy = gsl_vector_get(neg_force, 2*i+Y);
-        total += sqrt(fx * fx + fy * fy);
+    pthread_mutex_lock(&sw->lock);
+    fprintf(sw->csv, "%d", (int)(pt - sw->points));
+    for (param i = 0; i < n_param; ++i) fprintf(sw->csv, ",%g", values[i]);
+    fprintf(sw->csv, ",%d,%g,%ld,%g,%g,%g,%s\n", warm, t_true, s->trace->relaxations[phase_true],
+            lowest, highest, length(sub(l->end, l->start)), quality_names[run_quality(s)]);
+    fflush(sw->csv);
+    sw->n_budget += hit_budget(s);
+    for (int i = 0; i < n; ++i) {
+        pt->l_ratio[i] = l_ratio[i];
+        pt->offset[i] = offset[i];
     }
-    return total;
-}
+    pt->done = 1;
+    pthread_mutex_unlock(&sw->lock);
 
-void calculate_neg_force(data *d, gsl_vector *neg_force) {
+LU_CLEANUP
+    free(laced);
+    free(tension);
+    free(l);
+    free_solver(s);
+    free_wheel(w);
+    LU_RETURN
+}
 
-    wheel *w = d->wheel;
-    load *l = d->load;
-    gsl_vector_set_zero(neg_force);
+void *sweep_worker(void *arg) {
 
     LU_STATUS
+    sweep *sw = arg;
+    double *l_ratio = NULL;
+    xy *offset = NULL;
+
+    LU_ALLOC(dbg, l_ratio, sw->n_holes)
+    LU_ALLOC(dbg, offset, sw->n_holes)
+
+    while (1) {
+        pthread_mutex_lock(&sw->lock);
+        if (sw->next >= sw->n_points || sw->status || ctx->cancel) {
+            pthread_mutex_unlock(&sw->lock);
+            break;
+        }
+        point *pt = &sw->points[sw->next++], *near = nearest_point(sw, pt);
+        if (near) {
+            for (int i = 0; i < sw->n_holes; ++i) {
+                l_ratio[i] = near->l_ratio[i];
+                offset[i] = near->offset[i];
+            }
+        }
+        pthread_mutex_unlock(&sw->lock);
+        if ((status = sweep_point(sw, pt, l_ratio, offset, near ? (int)(near - sw->points) : -1))) {
+            pthread_mutex_lock(&sw->lock);
+            sw->status = status;
+            pthread_mutex_unlock(&sw->lock);
+            break;
+        }
+    }
 
-    data params;
-    params.load = load;
-    params.i_rim = i_rim;
-    params.wheel = w;
-    params.zero = w->rim[i_rim];
-    xy f_start = force(w, i_rim, params.zero, load);
-    // steepest descent direction is the direction of the force
-    params.descent = norm(f_start);
-    if (verbose) {
-        ludebug(dbg, "Relaxing at %d (%g,%g) along (%g,%g)",
-                i_rim, params.zero.x, params.zero.y, params.descent.x, params.descent.y);
-    }
-
-    gsl_min_fminimizer *s = NULL;
-    LU_ASSERT(s = gsl_min_fminimizer_alloc(gsl_min_fminimizer_quad_golden), LU_ERR, dbg, "Cannot create minimizer")
-
-    // calculate limit for range
-    int i_before = (i_rim - 1 + w->n_holes) % w->n_holes;
-    int i_after = (i_rim + 1 + w->n_holes) % w->n_holes;
-    xy before = w->rim[i_before], after = w->rim[i_after];
-    if (verbose) ludebug(dbg, "Before: (%g,%g); After: (%g,%g)", before.x, before.y, after.x, after.y);
-    xy u = norm(sub(after, before));         // x axis
-    xy v = {-u.y, u.x}; // y axis, pointing away from hub
-    xy q = sub(params.zero, before);
-    // distance above line in uv frame divided by sin(angle)
-    double du = cross(u, q);
-    double d = -du / dot(v, params.descent); // distance along descent line
-    if (verbose) ludebug(dbg, "Limit %g in uv; %g along descent", du, d);
-    double lo = -fabs(d), hi = fabs(d);
-    lo = lo < -10 ? -10 : lo; hi = hi > 10 ? 10 : hi;
-    if (verbose) ludebug(dbg, "Range: %g - %g along (%g,%g)", lo, hi, params.descent.x, params.descent.y);
-
-    gsl_function f;
-    f.function = f_abs_force;
-    f.params = &params;
-    LU_ASSERT(!gsl_min_fminimizer_set(s, &f, 0, lo, hi), LU_ERR, dbg, "Cannot set minimizer")
-
-    for (int iter = 0; iter < max_iter && !sig_exit; ++iter) {
-        LU_ASSERT(!gsl_min_fminimizer_iterate(s), LU_ERR, dbg, "Minimizer failed");
-        double x_lo = gsl_min_fminimizer_x_lower(s);
-        double x_hi = gsl_min_fminimizer_x_upper(s);
-        double x = gsl_min_fminimizer_minimum(s);
-        if (verbose) ludebug(dbg, "Minimize: %d; %g (%g - %g)", iter, x, x_lo, x_hi);
-        int gsl_status = gsl_min_test_interval(x_lo, x_hi, EPSABS, EPSREL);
-        if (gsl_status == GSL_SUCCESS) break;
-        LU_ASSERT(gsl_status == GSL_CONTINUE, LU_ERR, dbg, "Test failed");
-    }
-}
-
-double energy(const gsl_vector *coeff, void *params) {
-    data *d = (data*)params;
-    double energy;
-    calculate_data(coeff, d);
-    calculate_energy(d, &energy);
-//    ludebug(dbg, "Energy: %g", energy);
-    return energy;
+LU_CLEANUP
+    free(l_ratio);
+    free(offset);
+    return NULL;
 }
 
-void neg_force(const gsl_vector *coeff, void *params, gsl_vector *neg_force) {
-    data *d = (data*)params;
-    calculate_data(coeff, d);
-    calculate_neg_force(d, neg_force);
-}
+int run_sweep(const char *pattern, const char *spec, options *opts) {
 
-void energy_and_neg_force(const gsl_vector *coeff, void *params, double *energy, gsl_vector *neg_force) {
-    data *d = (data*)params;
-    calculate_data(coeff, d);
-    calculate_energy(d, energy);
-    calculate_neg_force(d, neg_force);
+    LU_STATUS
+    sweep sw = {0};
+    wheel *w = NULL;
+    pthread_t *threads = NULL;
+    lustr path = {0};
+    int n_started = 0, locked = 0;
+    struct timespec start;
+
+    // defaults from make_wheel()
+    LU_CHECK(laced_wheel(dbg, pattern, &w))
+    double defaults[n_param] = {w->r_hub, w->r_rim, w->tension, w->e_spoke, w->e_rim};
+    for (param i = 0; i < n_param; ++i) {
+        sw.lo[i] = sw.hi[i] = defaults[i];
+        sw.n[i] = 1;
+    }
+    LU_CHECK(parse_sweep(spec, &sw))
+    sw.pattern = pattern;
+    sw.opts = *opts;
+    sw.opts.trace = NULL;
+    sw.opts.no_dump = 1;
+    // parallel across points, not within them
+    sw.opts.n_threads = 1;
+    int n_threads = opts->n_threads > 0 ? opts->n_threads : sysconf(_SC_NPROCESSORS_ONLN);
+    sw.n_holes = w->n_holes;
+    sw.n_points = 1;
+    for (param i = 0; i < n_param; ++i) sw.n_points *= sw.n[i];
+    LU_ALLOC(dbg, sw.points, sw.n_points)
+    for (int i = 0; i < sw.n_points; ++i) {
+        // last parameter varies fastest
+        for (int j = n_param - 1, k = i; j >= 0; k /= sw.n[j--]) sw.points[i].index[j] = k % sw.n[j];
+        LU_ALLOC(dbg, sw.points[i].l_ratio, sw.n_holes)
+        LU_ALLOC(dbg, sw.points[i].offset, sw.n_holes)
+    }
+
+    LU_CHECK(lustr_sprintf(dbg, &path, "%s-sweep.csv", pattern))
+    LU_CHECK(lufle_open(dbg, path.c, "w", &sw.csv))
+    fprintf(sw.csv, "point");
+    for (param i = 0; i < n_param; ++i) fprintf(sw.csv, ",%s", param_names[i]);
+    fprintf(sw.csv, ",warm,true_seconds,true_relaxations,min_tension,max_tension,deflection,quality\n");
+    LU_ASSERT(!pthread_mutex_init(&sw.lock, NULL), LU_ERR, dbg, "Cannot create lock")
+    locked = 1;
+
+    luinfo(dbg, "Sweeping %d points with %d threads to %s", sw.n_points, n_threads, path.c);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    LU_ALLOC(dbg, threads, n_threads)
+    for (; n_started < n_threads; ++n_started) {
+        LU_ASSERT(!pthread_create(&threads[n_started], NULL, sweep_worker, &sw), LU_ERR, dbg, "Cannot start thread")
+    }
+
+LU_CLEANUP
+    for (int i = 0; i < n_started; ++i) pthread_join(threads[i], NULL);
+    if (n_started) luinfo(dbg, "Sweep took %.3fs; %d of %d points hit the budget",
+            elapsed(&start), sw.n_budget, sw.n_points);
+    if (!status) status = sw.status;
+    if (locked) pthread_mutex_destroy(&sw.lock);
+    if (sw.csv) fclose(sw.csv);
+    if (sw.points) {
+        for (int i = 0; i < sw.n_points; ++i) {
+            free(sw.points[i].l_ratio);
+            free(sw.points[i].offset);
+        }
+    }
+    free(sw.points);
+    free(threads);
+    free_wheel(w);
+    status = lustr_free(&path, status);
+    LU_RETURN
 }
 
-int alloc_data(data **d, wheel *w, load *l) {
+// monte carlo tolerances.  each sample perturbs the spoke lengths, hub
+// hole positions and rim segment lengths of the trued wheel (normally
+// distributed, with standard deviations in mm) and finds the new
+// equilibrium by newton steps from the trued rim.  all samples share one
+// factorisation of the trued stiffness.  thread i takes samples i,
+// i+n_threads, ... with its own rng, seeded from the global one, so the
+// results depend only on the seed and the number of threads.
+
+typedef enum {
+    tolerance_l_spoke,
+    tolerance_hub,
+    tolerance_rim,
+    n_tolerance
+} tolerance;
+
+const char *tolerance_names[n_tolerance] = {"l_spoke", "hub", "rim"};
+
+#define DEFAULT_SAMPLES 1000
+#define MAX_TOLERANCE_STEP 30
+
+typedef struct {
+    double sd[n_tolerance];
+    int n_samples;
+    wheel *wheel;
+    stiffness *k;          // factorised for the trued wheel
+    double *tension0;      // trued tensions (rim order)
+    double *min_tension;   // per sample
+    double *max_tension;
+    double *deviation;     // largest change in any spoke, per sample
+    int *converged;        // per sample (others are not in the statistics)
+} tolerances;
+
+typedef struct {
+    tolerances *t;
+    int id;
+    int n_threads;
+    unsigned long seed;
+    double *sum_sq;        // per spoke, change in tension squared
+    int n_own;             // samples that needed their own factorisation
+    int n_unconverged;
+    int status;
+} tolerance_thread;
+
+// per thread state for tolerance_sample()
+typedef struct {
+    data *d;
+    stiffness *k;          // shares the trued factorisation
+    gsl_rng *r;
+    gsl_vector_view x, g, u, x1, g1;
+    gsl_matrix_view h;     // own factorisation, if the shared one fails
+    gsl_permutation *perm;
+    double *tension;
+} tolerance_work;
+
+int parse_tolerances(const char *spec, tolerances *t) {
     LU_STATUS
-    LU_ALLOC(dbg, *d, 1);
-    (*d)->wheel = w;
-    (*d)->load = l;
-    LU_ALLOC(dbg, (*d)->offset, w->n_holes)
-    LU_ALLOC(dbg, (*d)->rim, w->n_holes)
-    LU_ALLOC(dbg, (*d)->spoke, w->n_holes);
-    LU_ALLOC(dbg, (*d)->spoke_extn, w->n_holes);
-    LU_ALLOC(dbg, (*d)->chord, w->n_holes);
-    LU_ALLOC(dbg, (*d)->chord_extn, w->n_holes);
+    const char *p = spec;
+    while (*p) {
+        size_t len = strcspn(p, "=");
+        int found = 0, used = 0;
+        if (len == 1 && *p == 'n') {
+            LU_ASSERT(sscanf(p + len, "=%d%n", &t->n_samples, &used) == 1 && t->n_samples > 0,
+                    LU_ERR_ARG, dbg, "Bad number of samples in %s", spec)
+            found = 1;
+        }
+        for (tolerance i = 0; i < n_tolerance && !found; ++i) {
+            if (strlen(tolerance_names[i]) == len && !strncmp(p, tolerance_names[i], len)) {
+                LU_ASSERT(sscanf(p + len, "=%lf%n", &t->sd[i], &used) == 1 && t->sd[i] >= 0,
+                        LU_ERR_ARG, dbg, "Bad tolerance for %s in %s", tolerance_names[i], spec)
+                found = 1;
+            }
+        }
+        LU_ASSERT(found, LU_ERR_ARG, dbg, "Unknown tolerance in %s", spec)
+        p += len + used;
+        LU_ASSERT(!*p || *p == ',', LU_ERR_ARG, dbg, "Bad tolerances %s", spec)
+        if (*p) p++;
+    }
     LU_NO_CLEANUP
 }
 
-void free_data(data *d) {
-    if (d) {
-        free(d->offset);
-        free(d->rim);
-        free(d->spoke);
-        free(d->spoke_extn);
-        free(d->chord);
-        free(d->chord_extn);
-        free(d);
-    }
-}
+// newton from the trued rim to the nearby equilibrium.  the trued wheel
+// is close to unstable in rotation, so the line search reduces the size
+// of the gradient rather than the energy.  steps use the shared (trued)
+// factorisation until it no longer gives a full step, and then the
+// hessian of the perturbed wheel.
+int tolerance_sample(tolerance_thread *tt, tolerance_work *wk, int sample) {
 
-void alloc_coeff(gsl_vector **coeff, wheel *w) {
-    *coeff = gsl_vector_calloc(2 * w->n_holes);
-}
+    LU_STATUS
+    tolerances *t = tt->t;
+    data *d = wk->d;
+    gsl_vector *x = &wk->x.vector, *g = &wk->g.vector, *u = &wk->u.vector;
+    gsl_vector *x1 = &wk->x1.vector, *g1 = &wk->g1.vector;
+    int n = t->wheel->n_holes, step = 0, own = 0, converged = 0, signum;
+    double e;
+
+    refresh_data(d);
+    for (int i = 0; i < n; ++i) {
+        d->l_spoke[i] += gsl_ran_gaussian(wk->r, t->sd[tolerance_l_spoke]);
+        d->inv_l_spoke[i] = 1 / d->l_spoke[i];
+        d->hub_x[i] += gsl_ran_gaussian(wk->r, t->sd[tolerance_hub]);
+        d->hub_y[i] += gsl_ran_gaussian(wk->r, t->sd[tolerance_hub]);
+        d->l_chord[i] += gsl_ran_gaussian(wk->r, t->sd[tolerance_rim]);
+        d->inv_l_chord[i] = 1 / d->l_chord[i];
+    }
 
-void log_energy(data *d, const char *msg, double *final_energy, double *final_force) {
-    double energy, total;
-    gsl_vector *neg_force = gsl_vector_alloc(d->wheel->n_holes * 2);
-    calculate_energy(d, &energy);
-    calculate_neg_force(d, neg_force);
-    total = sum_force(d->wheel, neg_force);
-    luinfo(dbg, "%s: Energy %g, Force %g", msg, energy, total);
-    if (final_energy) *final_energy = energy;
-    if (final_force) *final_force = total;
-    free(neg_force);
-}
+    gsl_vector_set_zero(x);
+    staged_energy_and_neg_force(x, d, &e, g);
+    for (; step < MAX_TOLERANCE_STEP; ++step) {
+        if ((converged = gsl_multimin_test_gradient(g, 1e-4) == GSL_SUCCESS)) break;
+        if (!own) {
+            LU_CHECK(stiffness_step(dbg, wk->k, g, u))
+        } else {
+            // data is still for x
+            calculate_hessian(d, &wk->h.matrix);
+            if (gsl_linalg_LU_decomp(&wk->h.matrix, wk->perm, &signum)
+                    || gsl_linalg_LU_solve(&wk->h.matrix, wk->perm, g, u)) break;
+        }
+        double gradient = vec_len(g), alpha = 1;
+        for (; alpha > MIN_NEWTON_STEP; alpha *= 0.5) {
+            gsl_vector_memcpy(x1, x);
+            gsl_blas_daxpy(-alpha, u, x1);
+            staged_energy_and_neg_force(x1, d, &e, g1);
+            if (vec_len(g1) <= (1 - 1e-4 * alpha) * gradient) break;
+        }
+        int accepted = alpha > MIN_NEWTON_STEP;
+        if (accepted) {
+            gsl_vector_memcpy(x, x1);
+            gsl_vector_memcpy(g, g1);
+        } else {
+            calculate_data(x, d);
+        }
+        // a short (or no) step means the shared factorisation is a poor fit
+        if (!own && (!accepted || alpha < 1)) {
+            own = 1;
+            tt->n_own++;
+        } else if (!accepted) {
+            break;
+        }
+    }
+    // without a nearby equilibrium (usually the rim turning under a net
+    // torque from the hub) the sample is recorded but not used
+    t->converged[sample] = converged;
+    if (!converged) {
+        tt->n_unconverged++;
+        calculate_data(x, d);
+    }
 
-void update_rim(gsl_vector *coeff, data *d, wheel *w) {
-    double shift = 0.0;
-    calculate_data(coeff, d);
-    for (int i = 0; i < w->n_holes; ++i) {
-        xy delta = sub(d->rim[i], w->rim[i]);
-        shift += length(delta);
-        w->rim[i] = d->rim[i];
+    spoke_tensions(d, wk->tension);
+    t->min_tension[sample] = INFINITY;
+    t->max_tension[sample] = -INFINITY;
+    t->deviation[sample] = 0;
+    for (int i = 0; i < n; ++i) {
+        double change = wk->tension[i] - t->tension0[i];
+        t->min_tension[sample] = fmin(t->min_tension[sample], wk->tension[i]);
+        t->max_tension[sample] = fmax(t->max_tension[sample], wk->tension[i]);
+        t->deviation[sample] = fmax(t->deviation[sample], fabs(change));
+        if (converged) tt->sum_sq[i] += change * change;
     }
-    shift = shift / w->n_holes;
-    ludebug(dbg, "Average shift %gmm", shift);
+
+    LU_NO_CLEANUP
 }
 
-int relax_f_fourier(wheel *wheel, load *load, double *final_energy, double *final_force) {
+void *tolerance_worker(void *arg) {
 
     LU_STATUS
-    gsl_vector *coeff = NULL, *step = NULL;
-    const gsl_multimin_fminimizer_type *T;
-    gsl_multimin_fminimizer *s = NULL;
-    gsl_multimin_function callbacks;
-    data *d = NULL;
-    int gsl_status = GSL_CONTINUE;
+    tolerance_thread *tt = arg;
+    tolerances *t = tt->t;
+    wheel *w = t->wheel;
+    int n = w->n_holes;
+    arena a = {0};
+    tolerance_work wk = {0};
+    double *h = NULL;
+
+    LU_ASSERT(wk.r = gsl_rng_alloc(gsl_rng_mt19937), LU_ERR, dbg, "Could not create PRNG")
+    gsl_rng_set(wk.r, tt->seed);
+    LU_CHECK(alloc_arena(dbg, &a, 2 * N_DATA_XY * n + N_DATA_DOUBLE * n + 5 * 2 * n + 4 * n * n + n))
+    LU_CHECK(arena_data(dbg, &a, &wk.d, w, NULL))
+    LU_CHECK(arena_vector(dbg, &a, &wk.x, 2 * n))
+    LU_CHECK(arena_vector(dbg, &a, &wk.g, 2 * n))
+    LU_CHECK(arena_vector(dbg, &a, &wk.u, 2 * n))
+    LU_CHECK(arena_vector(dbg, &a, &wk.x1, 2 * n))
+    LU_CHECK(arena_vector(dbg, &a, &wk.g1, 2 * n))
+    LU_ASSERT(h = ARENA_DOUBLE(&a, 4 * n * n), LU_ERR_MEM, dbg, "Arena too small")
+    wk.h = gsl_matrix_view_array(h, 2 * n, 2 * n);
+    LU_ASSERT(wk.perm = gsl_permutation_alloc(2 * n), LU_ERR_MEM, dbg, "Cannot allocate permutation")
+    LU_ASSERT(wk.tension = ARENA_DOUBLE(&a, n), LU_ERR_MEM, dbg, "Arena too small")
+    LU_CHECK(share_stiffness(dbg, t->k, w, &wk.k))
+    wk.d->to_rim = &xy_coeff_to_rim;
+
+    for (int i = tt->id; i < t->n_samples && !ctx->cancel; i += tt->n_threads) {
+        LU_CHECK(tolerance_sample(tt, &wk, i))
+    }
 
-    LU_CHECK(alloc_data(&d, wheel, load))
-    d->to_rim = &fourier_coeff_to_rim;
-    alloc_coeff(&coeff, wheel);
+LU_CLEANUP
+    free_stiffness(wk.k);
+    if (wk.perm) gsl_permutation_free(wk.perm);
+    free(wk.d);
+    free(a.base);
+    if (wk.r) gsl_rng_free(wk.r);
+    tt->status = status;
+    return NULL;
+}
 
-    calculate_data(coeff, d);
-    log_energy(d, "Before relax f Fourier", NULL, NULL);
-
-    callbacks.n = 2 * wheel->n_holes;
-    callbacks.params = d;
-    callbacks.f = energy;
-
-    T = gsl_multimin_fminimizer_nmsimplex;
-    s = gsl_multimin_fminimizer_alloc(T, 2 * wheel->n_holes);
-//    luinfo(dbg, "Method %s", gsl_multimin_fminimizer_name(s));
-    step = gsl_vector_alloc(2 * wheel->n_holes);
-    gsl_vector_set_all(step, 1e-4);
-    gsl_multimin_fminimizer_set(s, &callbacks, coeff, step);
-
-    for (int iter = 0; iter < MAX_ITER_OUTER && gsl_status == GSL_CONTINUE && !sig_exit; ++iter) {
-//        ludebug(dbg, "Iteration %d", iter);
-        gsl_status = gsl_multimin_fminimizer_iterate(s);
-        if (gsl_status == GSL_ENOPROG) {
-            luwarn(dbg, "Cannot progress");
-        } else if (!gsl_status) {
-            double size = gsl_multimin_fminimizer_size(s);
-            if (!iter || !(iter & (iter - 1))) ludebug(dbg, "Size %g (%d)", size, iter);
-            gsl_status = gsl_multimin_test_size(size, MAX_SIZE);
-            if (gsl_status == GSL_SUCCESS) luinfo(dbg, "Minimum energy: %g", s->fval);
+// solve n perturbed wheels (see above) and report the spread in tension.
+int run_tolerances(const char *pattern, const char *spec, options *opts) {
+
+    LU_STATUS
+    tolerances t = {{0.1, 0.05, 0.1}, DEFAULT_SAMPLES};
+    wheel *w = NULL;
+    solver *s = NULL;
+    pthread_t *threads = NULL;
+    tolerance_thread *tt = NULL;
+    double *spread = NULL, *rms = NULL;
+    lustr path = {0};
+    FILE *csv = NULL;
+    int n_started = 0, n_threads = opts->n_threads > 0 ? opts->n_threads : sysconf(_SC_NPROCESSORS_ONLN);
+    struct timespec start;
+
+    LU_CHECK(parse_tolerances(spec, &t))
+    LU_CHECK(trued_wheel(ctx, pattern, opts, &w, &s))
+    if (hit_budget(s)) luwarn(dbg, "Truing hit the budget; samples are about an untrue wheel");
+    int n = w->n_holes;
+    t.wheel = w;
+    LU_ALLOC(dbg, t.tension0, n)
+    LU_ALLOC(dbg, t.min_tension, t.n_samples)
+    LU_ALLOC(dbg, t.max_tension, t.n_samples)
+    LU_ALLOC(dbg, t.deviation, t.n_samples)
+    LU_ALLOC(dbg, t.converged, t.n_samples)
+    LU_ALLOC(dbg, spread, t.n_samples)
+    LU_ALLOC(dbg, rms, n)
+    LU_ALLOC(dbg, threads, n_threads)
+    LU_ALLOC(dbg, tt, n_threads)
+
+    // the one factorisation, shared by all threads
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    refresh_data(s->d);
+    s->d->to_rim = &xy_coeff_to_rim;
+    s->d->load = NULL;
+    gsl_vector_set_zero(&s->coeff.vector);
+    calculate_data(&s->coeff.vector, s->d);
+    spoke_tensions(s->d, t.tension0);
+    LU_CHECK(alloc_stiffness(dbg, &t.k, w))
+    LU_CHECK(factorise_stiffness(dbg, s->d, t.k))
+
+    luinfo(dbg, "%d samples (%s %gmm, %s %gmm, %s %gmm) with %d threads", t.n_samples,
+            tolerance_names[tolerance_l_spoke], t.sd[tolerance_l_spoke], tolerance_names[tolerance_hub],
+            t.sd[tolerance_hub], tolerance_names[tolerance_rim], t.sd[tolerance_rim], n_threads);
+    for (int i = 0; i < n_threads; ++i) {
+        tt[i].t = &t;
+        tt[i].id = i;
+        tt[i].n_threads = n_threads;
+        tt[i].seed = gsl_rng_get(ctx->rng);
+        LU_ALLOC(dbg, tt[i].sum_sq, n)
+    }
+    for (; n_started < n_threads; ++n_started) {
+        LU_ASSERT(!pthread_create(&threads[n_started], NULL, tolerance_worker, &tt[n_started]), LU_ERR, dbg,
+                "Cannot start thread")
+    }
+    for (; n_started; --n_started) pthread_join(threads[n_started - 1], NULL);
+    int n_unconverged = 0, n_own = 0;
+    for (int i = 0; i < n_threads; ++i) {
+        LU_CHECK(tt[i].status)
+        n_unconverged += tt[i].n_unconverged;
+        n_own += tt[i].n_own;
+        for (int j = 0; j < n; ++j) rms[j] += tt[i].sum_sq[j];
+    }
+    luinfo(dbg, "Solved %d samples in %.3fs (%s stiffness; %d needed their own)", t.n_samples, elapsed(&start),
+            t.k->blocks ? "circulant" : "dense", n_own);
+    if (n_unconverged) luwarn(dbg, "%d samples have no nearby equilibrium (excluded)", n_unconverged);
+    LU_ASSERT(n_unconverged < t.n_samples, LU_ERR, dbg, "No samples converged")
+
+    LU_CHECK(lustr_sprintf(dbg, &path, "%s-tolerance.csv", pattern))
+    LU_CHECK(lufle_open(dbg, path.c, "w", &csv))
+    fprintf(csv, "sample,converged,min_tension,max_tension,spread,deviation\n");
+    int n_slack = 0, n_spread = 0;
+    for (int i = 0; i < t.n_samples; ++i) {
+        double range = t.max_tension[i] - t.min_tension[i];
+        fprintf(csv, "%d,%d,%g,%g,%g,%g\n", i, t.converged[i], t.min_tension[i], t.max_tension[i], range,
+                t.deviation[i]);
+        if (t.converged[i]) {
+            spread[n_spread++] = range;
+            if (t.min_tension[i] <= 0) n_slack++;
         }
     }
-
-    log_energy(d, "After relax f Fourier", final_energy, final_force);
-    update_rim(s->x, d, wheel);
+    double worst = 0, trued_spread = 0;
+    for (int j = 0; j < n; ++j) {
+        rms[j] = sqrt(rms[j] / n_spread);
+        worst = fmax(worst, rms[j]);
+    }
+    gsl_sort(t.tension0, 1, n);
+    trued_spread = t.tension0[n - 1] - t.tension0[0];
+    gsl_sort(spread, 1, n_spread);
+    luinfo(dbg, "Trued tension spread %gN; perturbed spread mean %gN, sd %gN",
+            trued_spread, gsl_stats_mean(spread, 1, n_spread), n_spread > 1 ? gsl_stats_sd(spread, 1, n_spread) : 0);
+    luinfo(dbg, "Spread percentiles: 5%% %gN, 50%% %gN, 95%% %gN",
+            gsl_stats_quantile_from_sorted_data(spread, 1, n_spread, 0.05),
+            gsl_stats_quantile_from_sorted_data(spread, 1, n_spread, 0.5),
+            gsl_stats_quantile_from_sorted_data(spread, 1, n_spread, 0.95));
+    luinfo(dbg, "Largest rms change for a single spoke %gN; %d samples with a slack spoke", worst, n_slack);
+    luinfo(dbg, "Samples: %s", path.c);
 
 LU_CLEANUP
-    gsl_multimin_fminimizer_free(s);
-    gsl_vector_free(step);
-    gsl_vector_free(coeff);
-    free_data(d);
+    for (; n_started; --n_started) pthread_join(threads[n_started - 1], NULL);
+    if (tt) {
+        for (int i = 0; i < n_threads; ++i) free(tt[i].sum_sq);
+    }
+    if (csv) fclose(csv);
+    free_stiffness(t.k);
+    free(t.tension0);
+    free(t.min_tension);
+    free(t.max_tension);
+    free(t.deviation);
+    free(t.converged);
+    free(spread);
+    free(rms);
+    free(threads);
+    free(tt);
+    free_solver(s);
+    free_wheel(w);
+    status = lustr_free(&path, status);
     LU_RETURN
 }
 
-double vec_len(gsl_vector *v) {
-    double l = 0;
-    for (int i = 0; i < v->size; ++i) l = l + gsl_vector_get(v, i) * gsl_vector_get(v, i);
-    return sqrt(l);
-}
+#define N_BENCH 100000
 
-int relax_fdf_xy(wheel *wheel, load *load, double *final_energy, double *final_force) {
+// time energy() and energy plus gradient (staged through calculate_data()
+// and fused), and incremental moves of single nodes, for each set of
+// kernels, on the laced wheel with some arbitrary displacement.
+int bench(const char *pattern, options *opts) {
 
     LU_STATUS
-    gsl_vector *coeff = NULL, *step = NULL;
-    const gsl_multimin_fdfminimizer_type *T;
-    gsl_multimin_fdfminimizer *s = NULL;
-    gsl_multimin_function_fdf callbacks;
-    data *d = NULL;
-    int gsl_status = GSL_CONTINUE;
-
-    LU_CHECK(alloc_data(&d, wheel, load))
-    d->to_rim = &xy_coeff_to_rim;
-    alloc_coeff(&coeff, wheel);
-
-    calculate_data(coeff, d);
-    log_energy(d, "Before relax fdf xy", NULL, NULL);
-
-    callbacks.n = 2 * wheel->n_holes;
-    callbacks.params = d;
-    callbacks.f = energy;
-    callbacks.df = neg_force;
-    callbacks.fdf = energy_and_neg_force;
-
-    T = gsl_multimin_fdfminimizer_steepest_descent;
-//    T = gsl_multimin_fdfminimizer_conjugate_fr;
-//    T = gsl_multimin_fdfminimizer_vector_bfgs2;
-    s = gsl_multimin_fdfminimizer_alloc(T, 2 * wheel->n_holes);
-//    luinfo(dbg, "Method %s", gsl_multimin_fdfminimizer_name(s));
-    gsl_multimin_fdfminimizer_set(s, &callbacks, coeff, 1e-4, 1e-3);
-
-    for (int iter = 0; iter < MAX_ITER_OUTER && gsl_status == GSL_CONTINUE && !sig_exit; ++iter) {
-//        ludebug(dbg, "Iteration %d", iter);
-        gsl_status = gsl_multimin_fdfminimizer_iterate(s);
-        if (gsl_status == GSL_ENOPROG) {
-            luwarn(dbg, "Cannot progress");
-        } else if (!gsl_status) {
-            gsl_status = gsl_multimin_test_gradient(s->gradient, 1e-4);
-            if (!iter || !(iter & (iter - 1))) ludebug(dbg, "Gradient %g (%d)", vec_len(s->gradient), iter);
-            if (gsl_status == GSL_SUCCESS) luinfo(dbg, "Minimum energy: %g", s->f);
+    wheel *wheel = NULL;
+    solver *s = NULL;
+    const kernels *all[] = {&scalar_kernels, &simd_kernels};
+    struct timespec start;
+
+    LU_CHECK(laced_wheel(dbg, pattern, &wheel))
+    LU_CHECK(alloc_solver(ctx, &s, wheel, opts))
+    s->d->to_rim = &xy_coeff_to_rim;
+    gsl_vector *coeff = &s->coeff.vector, *neg_force = &s->neg_force.vector;
+    for (int i = 0; i < coeff->size; ++i) gsl_vector_set(coeff, i, 0.1 * sin(i));
+
+    for (int i = 0; i < sizeof(all) / sizeof(all[0]); ++i) {
+        double e = 0, f = 0;
+        s->d->k = all[i];
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int j = 0; j < N_BENCH; ++j) e += energy(coeff, s->d);
+        double t_e = elapsed(&start);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int j = 0; j < N_BENCH; ++j) staged_energy_and_neg_force(coeff, s->d, &f, neg_force);
+        double t_staged = elapsed(&start);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int j = 0; j < N_BENCH; ++j) fused_energy_and_neg_force(coeff, s->d, &f, neg_force);
+        double t_fused = elapsed(&start);
+        luinfo(dbg, "%s: %.1fns per energy(), %.1fns per staged and %.1fns per fused energy and gradient (energy %.12g)",
+                all[i]->name, 1e9 * t_e / N_BENCH, 1e9 * t_staged / N_BENCH, 1e9 * t_fused / N_BENCH, e / N_BENCH);
+        luinfo(dbg, "%s: %.0f energy and %.0f staged and %.0f fused energy and gradient evaluations per second",
+                all[i]->name, N_BENCH / t_e, N_BENCH / t_staged, N_BENCH / t_fused);
+        calculate_data(coeff, s->d);
+        reset_incremental(s->d);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int j = 0; j < N_BENCH; ++j) {
+            int k = j % wheel->n_holes;
+            xy p = s->d->rim[k];
+            p.x += (j / wheel->n_holes) % 2 ? -1e-3 : 1e-3;
+            move_rim(s->d, k, p);
+            f += rim_neg_force(s->d, k).x;
         }
+        double t_move = elapsed(&start);
+        luinfo(dbg, "%s: %.1fns per incremental move (energy %.12g)",
+                all[i]->name, 1e9 * t_move / N_BENCH, incremental_energy(s->d));
     }
 
-    log_energy(d, "After relax fdf xy", final_energy, final_force);
-    update_rim(s->x, d, wheel);
-
 LU_CLEANUP
-    gsl_multimin_fdfminimizer_free(s);
-    gsl_vector_free(coeff);
-    free_data(d);
+    free_solver(s);
+    free_wheel(wheel);
     LU_RETURN
 }
 
-int relax(wheel *w, load *l, int n) {
+#define FD_STEP 1e-6
+#define FD_TOLERANCE 1e-6
+#define N_INCREMENTAL 1000
+
+// random moves of single nodes and changes of single spoke lengths,
+// comparing the incremental energy and force with a full recalculation
+// (coeff and data are left at the final state).
+int check_incremental(solver *s, gsl_vector *neg_force) {
+
     LU_STATUS
-    double final_energy, final_force;
-    for (int i = 0; i < n; ++i) {
-        ludebug(dbg, "Relax %d/%d", i , n);
-        LU_CHECK(relax_fdf_xy(w, l, NULL, NULL))
-        LU_CHECK(relax_f_fourier(w, l, &final_energy, &final_force))
-        if (final_force <= MAX_FORCE) break;
+    data *d = s->d;
+    wheel *w = s->wheel;
+    gsl_vector *coeff = &s->coeff.vector;
+    double err_e = 0, err_f = 0, e, scale = 0;
+
+    calculate_data(coeff, d);
+    reset_incremental(d);
+    for (int j = 0; j < N_INCREMENTAL; ++j) {
+        int i = gsl_rng_uniform_int(ctx->rng, w->n_holes);
+        if (j % 10) {
+            xy p = {d->rim[i].x + 0.02 * (gsl_rng_uniform(ctx->rng) - 0.5), d->rim[i].y + 0.02 * (gsl_rng_uniform(ctx->rng) - 0.5)};
+            move_rim(d, i, p);
+            gsl_vector_set(coeff, 2*i+X, d->offset[i].x);
+            gsl_vector_set(coeff, 2*i+Y, d->offset[i].y);
+        } else {
+            set_l_spoke(d, i, d->l_spoke[i] * (1 + 2e-4 * (gsl_rng_uniform(ctx->rng) - 0.5)));
+        }
     }
+    double e_inc = incremental_energy(d);
+    // the fused evaluation does not touch the cached data
+    fused_energy_and_neg_force(coeff, d, &e, neg_force);
+    err_e = fabs(e_inc - e);
+    for (int i = 0; i < w->n_holes; ++i) {
+        xy f = rim_neg_force(d, i);
+        scale = fmax(scale, fmax(fabs(gsl_vector_get(neg_force, 2*i+X)), fabs(gsl_vector_get(neg_force, 2*i+Y))));
+        err_f = fmax(err_f, fmax(fabs(f.x - gsl_vector_get(neg_force, 2*i+X)), fabs(f.y - gsl_vector_get(neg_force, 2*i+Y))));
+    }
+    luinfo(dbg, "Incremental: energy %.12g (full %.12g), force error %g (largest %g) after %d updates",
+            e_inc, e, err_f, scale, N_INCREMENTAL);
+    LU_ASSERT(err_e <= FD_TOLERANCE * fabs(e) && err_f <= FD_TOLERANCE * scale, LU_ERR, dbg,
+            "Incremental check failed")
+
     LU_NO_CLEANUP
 }
 
-#define TARGET_WOBBLE 3e-3
-#define DAMP_TRUE 0.5
-#define DAMP_TENSION 0.5
-
-int true(wheel *w) {
+// compare the fused gradient with the staged gradient and with central
+// finite differences of energy(), for each set of kernels, on the laced
+// wheel with some arbitrary displacement and a load, then check the
+// incremental evaluation.  fails if any differ by more than FD_TOLERANCE
+// relative to the largest component.
+int check_gradient(const char *pattern, options *opts) {
 
     LU_STATUS
-
-    LU_CHECK(relax(w, NULL, MAX_ITER_INNER))
-    LU_CHECK(dump_wheel(dbg, w, "untrue"))
-
-    while(!sig_exit) {
-
-        double r_target = 0;
-        for (int i = 0; i < w->n_holes; ++i) r_target += length(w->rim[i]);
-        r_target = r_target / w->n_holes;
-        double wobble = 0, shift = 0;
-        for (int i = 0; i < w->n_holes; ++i) wobble += fabs(length(w->rim[i]) - r_target);
-        wobble /= w->n_holes;
-        luinfo(dbg, "Average radial wobble %gmm", wobble);
-        if (wobble <= TARGET_WOBBLE || sig_exit) break;
-        for (int i = 0; i < w->n_holes; ++i) {
-            double l = length(w->rim[i]);
-            if (l > r_target) {
-                double excess = DAMP_TRUE * (l - r_target);
-                w->l_spoke[w->rim_to_hub[i]] -= excess;
-                shift += excess;
-            }
-        }
-        luinfo(dbg, "Total correction %gmm", shift);
-        LU_CHECK(relax(w, NULL, MAX_ITER_INNER));
-
-        double tension = 0;
-        for (int i = 0; i < w->n_holes; ++i) {
-            int j = w->rim_to_hub[i];
-            double l = length(sub(w->rim[i], w->hub[j]));
-            double l0 = w->l_spoke[j];
-            tension += w->e_spoke * (l - l0) / l0;
+    wheel *wheel = NULL;
+    solver *s = NULL;
+    load *l = NULL;
+    gsl_vector *staged = NULL;
+    const kernels *all[] = {&scalar_kernels, &simd_kernels};
+
+    LU_CHECK(laced_wheel(dbg, pattern, &wheel))
+    LU_CHECK(alloc_solver(ctx, &s, wheel, opts))
+    LU_CHECK(alloc_load(dbg, &l))
+    LU_ASSERT(staged = gsl_vector_alloc(2 * wheel->n_holes), LU_ERR_MEM, dbg, "Cannot allocate gradient")
+    l->mass = 1;
+    l->start = wheel->rim[l->i_rim];
+    s->d->to_rim = &xy_coeff_to_rim;
+    s->d->load = l;
+    gsl_vector *coeff = &s->coeff.vector, *fused = &s->neg_force.vector;
+    for (int i = 0; i < coeff->size; ++i) gsl_vector_set(coeff, i, 0.1 * sin(i));
+
+    for (int i = 0; i < sizeof(all) / sizeof(all[0]); ++i) {
+        double e_fused, e_staged, scale = 0, err_staged = 0, err_fd = 0;
+        s->d->k = all[i];
+        fused_energy_and_neg_force(coeff, s->d, &e_fused, fused);
+        staged_energy_and_neg_force(coeff, s->d, &e_staged, staged);
+        for (int j = 0; j < coeff->size; ++j) {
+            double x = gsl_vector_get(coeff, j), g = gsl_vector_get(fused, j);
+            gsl_vector_set(coeff, j, x + FD_STEP);
+            double e_plus = energy(coeff, s->d);
+            gsl_vector_set(coeff, j, x - FD_STEP);
+            double e_minus = energy(coeff, s->d);
+            gsl_vector_set(coeff, j, x);
+            scale = fmax(scale, fabs(g));
+            err_staged = fmax(err_staged, fabs(g - gsl_vector_get(staged, j)));
+            err_fd = fmax(err_fd, fabs(g - (e_plus - e_minus) / (2 * FD_STEP)));
         }
-        tension /= w->n_holes;
-        // df/dl = e/l0 so dl = df l0 / e
-        double error = tension - w->tension;
-        luinfo(dbg, "Tension excess is %g", error);
-        for (int i = 0; i < w->n_holes; ++i) {
-            // if tension is too large, correction is positive and spoke is extended
-            w->l_spoke[i] += DAMP_TENSION * w->l_spoke[i] * error / w->e_spoke;
-        }
-        LU_CHECK(relax(w, NULL, MAX_ITER_INNER));
+        luinfo(dbg, "%s: energy %.12g (staged %.12g), largest gradient %g, error %g against staged, %g against finite difference",
+                all[i]->name, e_fused, e_staged, scale, err_staged, err_fd);
+        LU_ASSERT(fabs(e_fused - e_staged) <= FD_TOLERANCE * fabs(e_staged), LU_ERR, dbg,
+                "Fused energy differs from staged")
+        LU_ASSERT(err_staged <= FD_TOLERANCE * scale && err_fd <= FD_TOLERANCE * scale, LU_ERR, dbg,
+                "Gradient check failed for %s kernels", all[i]->name)
     }
 
-    LU_CHECK(dump_wheel(dbg, w, "true"))
-    luinfo(dbg, "True!");
+    LU_CHECK(check_incremental(s, staged))
 
 LU_CLEANUP
+    if (staged) gsl_vector_free(staged);
+    free(l);
+    free_solver(s);
+    free_wheel(wheel);
     LU_RETURN
 }
 
-int lace(wheel *wheel) {
+#define N_COMPARE_ROUNDS 10
+// the first is the reference for the rim position
+const char *compare_pipelines[] = {"newton,nm", "sd,nm", "cg,nm", "bfgs2,nm", "newton,bfgs2,nm", "cell,newton", "gs,nm", "ml"};
+
+// time to relax a freshly laced wheel to MAX_FORCE, for each pipeline,
+// and the largest difference in rim position from the first.
+int compare(int n_patterns, char **patterns, options *opts) {
 
     LU_STATUS
-    double *tension = NULL;
+    wheel *wheel = NULL;
+    solver *s = NULL;
+    xy *reference = NULL;
+    struct timespec start;
+    int n_runs = 0, n_budget = 0;
+
+    for (int i = 0; i < n_patterns && !ctx->cancel; ++i) {
+        for (int j = 0; j < sizeof(compare_pipelines) / sizeof(compare_pipelines[0]) && !ctx->cancel; ++j) {
+            options local = *opts;
+            LU_CHECK(parse_pipeline(dbg, compare_pipelines[j], &local))
+            LU_CHECK(laced_wheel(dbg, patterns[i], &wheel))
+            LU_CHECK(alloc_solver(ctx, &s, wheel, &local))
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int k = 0; k < N_COMPARE_ROUNDS && !stop_early(s); ++k) {
+                LU_CHECK(relax(s, NULL, 1))
+                if (s->force <= MAX_FORCE) break;
+            }
+            double t = elapsed(&start), diff = 0;
+            if (!j) {
+                free(reference);
+                LU_ALLOC(dbg, reference, wheel->n_holes)
+                for (int k = 0; k < wheel->n_holes; ++k) reference[k] = wheel->rim[k];
+            }
+            for (int k = 0; k < wheel->n_holes; ++k) diff = fmax(diff, length(sub(wheel->rim[k], reference[k])));
+            luinfo(dbg, "%s %s: %.3fs, %ld f, %ld df, force %g (%s), rim differs by %gmm",
+                    patterns[i], compare_pipelines[j], t,
+                    s->trace->f_evals[phase_lace], s->trace->df_evals[phase_lace], s->force,
+                    quality_names[run_quality(s)], diff);
+            n_runs++;
+            n_budget += hit_budget(s);
+            free_solver(s); s = NULL;
+            free_wheel(wheel); wheel = NULL;
+        }
+    }
+    luinfo(dbg, "%d of %d runs hit the budget", n_budget, n_runs);
+
+LU_CLEANUP
+    free(reference);
+    free_solver(s);
+    free_wheel(wheel);
+    LU_RETURN
+}
 
-    LU_ALLOC(dbg, tension, wheel->n_holes);
+// regression: true and deform a fixed set of patterns (as stress does),
+// recording the work and the result of each phase, and compare with a baseline
+// csv from an earlier run (numbers must agree within tolerance; time is
+// only reported).
+
+#define REGRESSION_ENERGY 1e-3  // relative
+#define REGRESSION_WOBBLE 1e-3  // mm
+#define REGRESSION_SLOWER 0.25  // fraction (warning only)
+
+const char *regression_patterns[] = {"3B", "12B", "2,0A", "2,-3B1", "1,3,0A"};
+#define N_REGRESSION_PHASES 2  // true and deform
+
+// one pattern and phase (a row of the csv)
+typedef struct {
+    char pattern[PACKED_MAX_NAME];
+    phase phase;
+    double seconds;
+    long relaxations, iterations, f_evals, df_evals;
+    double energy, force, wobble;
+    quality quality;
+} regression;
+
+void note_regression(solver *s, const char *pattern, phase p, regression *r) {
+    snprintf(r->pattern, sizeof(r->pattern), "%s", pattern);
+    r->phase = p;
+    r->seconds = s->trace->seconds[p];
+    r->relaxations = s->trace->relaxations[p];
+    r->iterations = s->trace->iterations[p];
+    r->f_evals = s->trace->f_evals[p];
+    r->df_evals = s->trace->df_evals[p];
+    r->energy = s->energy;
+    r->force = s->force;
+    r->wobble = radial_wobble(s->wheel);
+    r->quality = s->quality[p];
+}
 
-    for (int i_hub = 0; i_hub < wheel->n_holes; i_hub += 2) {
-        int offset = wheel->offset[(i_hub / 2) % wheel->n_offsets];
-        int i_rim = (i_hub + 2 * offset + wheel->n_holes) % wheel->n_holes;
-        wheel->hub_to_rim[i_hub] = i_rim;
-        wheel->rim_to_hub[i_rim] = i_hub;
-        wheel->hub[i_hub] = xy_on_circle(wheel->r_hub, i_hub, wheel->n_holes);
-        wheel->rim[i_rim] = xy_on_circle(wheel->r_rim, i_rim, wheel->n_holes);
-    }
-    for (int i = 0; i < wheel->n_holes; i += 2) {
-        int offset = wheel->offset[(i / 2) % wheel->n_offsets];
-        int i_hub = (i + 2 * wheel->align + 1 + wheel->n_holes) % wheel->n_holes;
-        int i_rim = (i + 2 * (offset + wheel->align) + 1 + wheel->n_holes) % wheel->n_holes;
-        wheel->hub_to_rim[i_hub] = i_rim;
-        wheel->rim_to_hub[i_rim] = i_hub;
-        wheel->hub[i_hub] = xy_on_circle(wheel->r_hub, i_hub, wheel->n_holes);
-        wheel->rim[i_rim] = xy_on_circle(wheel->r_rim, i_rim, wheel->n_holes);
-    }
+// r holds N_REGRESSION_PHASES rows
+int regression_run(const char *pattern, options *opts, regression *r) {
 
-    // set lengths so that all have desired radial tension
-    for (int i_hub = 0; i_hub < wheel->n_holes; ++i_hub) {
-        int i_rim = wheel->hub_to_rim[i_hub];
-        double l = length(sub(wheel->hub[i_hub], wheel->rim[i_rim]));
-        double theta = angle_to_rim(wheel, i_hub);
-        double strain = wheel->tension / (sin(theta) * wheel->e_spoke);
-        wheel->l_spoke[i_hub] = l * (1 - strain);
-    }
+    LU_STATUS
+    wheel *w = NULL;
+    solver *s = NULL;
+    load *l = NULL;
 
-    LU_CHECK(dump_wheel(dbg, wheel, "laced"))
+    // as stress()
+    LU_CHECK(trued_wheel(ctx, pattern, opts, &w, &s))
+    note_regression(s, pattern, phase_true, &r[0]);
+    LU_CHECK(alloc_load(dbg, &l))
+    LU_CHECK(deform(s, l))
+    note_regression(s, pattern, phase_deform, &r[1]);
 
 LU_CLEANUP
-    free(tension);
+    free(l);
+    free_solver(s);
+    free_wheel(w);
     LU_RETURN
 }
 
-int deform(wheel *wheel, load *l) {
+int write_regression(const char *path, regression *r, int n) {
 
     LU_STATUS
+    FILE *csv = NULL;
 
-    for (int i = 0; i < N_DEFORM; ++i) {
-        l->mass = 10 * (float)(i + 1) / N_DEFORM;
-        ludebug(dbg,"Mass %gkg", l->mass);
-        l->start = wheel->rim[l->i_rim];
-        LU_CHECK(relax(wheel, l, MAX_ITER_INNER))
+    LU_CHECK(lufle_open(dbg, path, "w", &csv))
+    fprintf(csv, "pattern,phase,seconds,relaxations,iterations,f_evals,df_evals,energy,force,wobble,quality\n");
+    for (int i = 0; i < n; ++i) {
+        fprintf(csv, "\"%s\",%s,%.6f,%ld,%ld,%ld,%ld,%.12g,%.12g,%.12g,%s\n", r[i].pattern, phase_names[r[i].phase],
+                r[i].seconds, r[i].relaxations, r[i].iterations, r[i].f_evals, r[i].df_evals,
+                r[i].energy, r[i].force, r[i].wobble, quality_names[r[i].quality]);
     }
 
-    LU_NO_CLEANUP
+LU_CLEANUP
+    if (csv) fclose(csv);
+    LU_RETURN
+}
+
+static int lookup_name(const char **names, int n, const char *name) {
+    for (int i = 0; i < n; ++i) if (!strcmp(names[i], name)) return i;
+    return -1;
 }
 
-int alloc_load(load **l) {
+int read_regression(const char *path, regression **r, int *n) {
 
     LU_STATUS
+    FILE *csv = NULL;
+    char line[256], p[16], q[16];
+    regression row;
+    int size = 0;
+
+    LU_CHECK(lufle_open(dbg, path, "r", &csv))
+    LU_ASSERT(fgets(line, sizeof(line), csv), LU_ERR_IO, dbg, "Empty baseline %s", path)
+    while (fgets(line, sizeof(line), csv)) {
+        LU_ASSERT(sscanf(line, "\"%32[^\"]\",%15[^,],%lf,%ld,%ld,%ld,%ld,%lf,%lf,%lf,%15s",
+                row.pattern, p, &row.seconds, &row.relaxations, &row.iterations, &row.f_evals, &row.df_evals,
+                &row.energy, &row.force, &row.wobble, q) == 11, LU_ERR_IO, dbg, "Bad baseline line: %s", line)
+        int phase = lookup_name(phase_names, n_phase, p), quality = lookup_name(quality_names, n_quality, q);
+        LU_ASSERT(phase >= 0 && quality >= 0, LU_ERR_IO, dbg, "Bad phase or quality: %s", line)
+        row.phase = phase;
+        row.quality = quality;
+        if (*n == size) {
+            size = size ? 2 * size : 16;
+            LU_ASSERT(*r = realloc(*r, size * sizeof(**r)), LU_ERR_MEM, dbg, "Cannot grow baseline")
+        }
+        (*r)[(*n)++] = row;
+    }
 
-    LU_ALLOC(dbg, *l, 1)
-    (*l)->g_norm.x = 1/sqrt(2);
-    (*l)->g_norm.y = -1/sqrt(2);
-//    (*l)->g_norm.x = 0;
-//    (*l)->g_norm.y = -1;
-    (*l)->i_rim = 0;
+LU_CLEANUP
+    if (csv) fclose(csv);
+    LU_RETURN
+}
 
-    LU_NO_CLEANUP
+// log the comparison and return the number of failures
+int check_regression(regression *base, regression *now) {
+
+    int failed = 0;
+    const char *pattern = now->pattern, *phase = phase_names[now->phase];
+
+    luinfo(dbg, "%s %s: %.3fs (%.3fs, %.2fx), %ld iterations (%ld), %ld f and %ld df evaluations (%ld, %ld)",
+            pattern, phase, now->seconds, base->seconds, base->seconds > 0 ? now->seconds / base->seconds : 1,
+            now->iterations, base->iterations, now->f_evals, now->df_evals, base->f_evals, base->df_evals);
+    if (now->seconds > (1 + REGRESSION_SLOWER) * base->seconds && now->seconds - base->seconds > 1e-3) {
+        luwarn(dbg, "%s %s is slower than the baseline", pattern, phase);
+    }
+    if (now->quality > base->quality) {
+        luerror(dbg, "%s %s quality %s (baseline %s)", pattern, phase,
+                quality_names[now->quality], quality_names[base->quality]);
+        failed++;
+    }
+    if (fabs(now->energy - base->energy) > REGRESSION_ENERGY * fabs(base->energy)) {
+        luerror(dbg, "%s %s energy %g (baseline %g)", pattern, phase, now->energy, base->energy);
+        failed++;
+    }
+    if (now->force > fmax(2 * base->force, MAX_FORCE)) {
+        luerror(dbg, "%s %s force %g (baseline %g)", pattern, phase, now->force, base->force);
+        failed++;
+    }
+    if (fabs(now->wobble - base->wobble) > REGRESSION_WOBBLE) {
+        luerror(dbg, "%s %s wobble %gmm (baseline %gmm)", pattern, phase, now->wobble, base->wobble);
+        failed++;
+    }
+    return failed;
 }
 
-int stress(const char *pattern) {
+// with no patterns, those in regression_patterns.  if path exists the
+// results are compared with it and written to path.new (to replace it
+// when the changes are intended), otherwise they are written to path.
+int regress(int n_patterns, char **patterns, const char *path, options *opts) {
 
     LU_STATUS
-    int *offsets = NULL, length = 0, holes = 0, padding;
-    char type, *path = NULL;
-    wheel *wheel = NULL, *original = NULL;
-    load *load = NULL;
+    regression *now = NULL, *base = NULL;
+    lustr out = {0};
+    int n_base = 0, n_failed = 0, n_checked = 0, exists = !access(path, R_OK);
 
-    luinfo(dbg, "Pattern '%s'", pattern);
-    LU_CHECK(unpack(dbg, pattern, &offsets, &length, &type, &padding))
-    LU_ASSERT(strchr("AB", type), LU_ERR, dbg, "Only symmetric types supported")
-    LU_CHECK(dump_pattern(dbg, offsets, length))
-    LU_CHECK(rim_size(dbg, length, &holes))
-    LU_CHECK(make_wheel(dbg, offsets, length, holes, padding, type, pattern, &wheel))
-    LU_CHECK(lace(wheel))
-    LU_CHECK(true(wheel))
-    LU_CHECK(copy_wheel(dbg, wheel, &original))
-    LU_CHECK(alloc_load(&load))
-    LU_CHECK(deform(wheel, load))
-    plot_multi_deform(dbg, original, wheel, load, pattern);
-//    plot_wheel(original, path);
+    if (!n_patterns) {
+        patterns = (char**)regression_patterns;
+        n_patterns = sizeof(regression_patterns) / sizeof(regression_patterns[0]);
+    }
+    opts->cache = NULL;  // every run trues
+    LU_ALLOC(dbg, now, n_patterns * N_REGRESSION_PHASES)
+    for (int i = 0; i < n_patterns && !ctx->cancel; ++i) {
+        LU_CHECK(regression_run(patterns[i], opts, &now[i * N_REGRESSION_PHASES]))
+    }
+    LU_ASSERT(!ctx->cancel, LU_ERR, dbg, "Interrupted")
+
+    if (exists) {
+        LU_CHECK(read_regression(path, &base, &n_base))
+        for (int i = 0; i < n_patterns * N_REGRESSION_PHASES; ++i) {
+            regression *b = NULL;
+            for (int j = 0; j < n_base && !b; ++j) {
+                if (!strcmp(base[j].pattern, now[i].pattern) && base[j].phase == now[i].phase) b = &base[j];
+            }
+            if (b) {
+                n_failed += check_regression(b, &now[i]);
+                n_checked++;
+            } else {
+                luwarn(dbg, "No baseline for %s %s", now[i].pattern, phase_names[now[i].phase]);
+            }
+        }
+        LU_CHECK(lustr_sprintf(dbg, &out, "%s.new", path))
+    } else {
+        LU_CHECK(lustr_sprintf(dbg, &out, "%s", path))
+    }
+    LU_CHECK(write_regression(out.c, now, n_patterns * N_REGRESSION_PHASES))
+    luinfo(dbg, "Results written to %s", out.c);
+    if (exists) {
+        luinfo(dbg, "%d phases compared with %s; %d checks failed", n_checked, path, n_failed);
+        LU_ASSERT(!n_failed, LU_ERR, dbg, "Results differ from the baseline")
+    }
 
 LU_CLEANUP
-    free_wheel(original);
-    free_wheel(wheel);
-    free(path);
-    free(offsets);
-    free(load);
+    free(now);
+    free(base);
+    status = lustr_free(&out, status);
     LU_RETURN
 }
 
 void new_handler(int sig) {
     luwarn(dbg, "Handler called with %d", sig);
-    sig_exit = 1;
+    spokes_cancel(ctx);
 }
 
 int set_handler() {
@@ -626,26 +1314,126 @@ int set_handler() {
 
 void usage(const char *progname) {
     luinfo(dbg, "Plot the stresses for a given spoke pattern");
-    luinfo(dbg, "%s -h        display this message", progname);
-    luinfo(dbg, "%s pattern   plot pattern to pattern.png", progname);
+    luinfo(dbg, "%s -h           display this message", progname);
+    luinfo(dbg, "%s pattern      plot pattern to pattern.png", progname);
     luinfo(dbg, "(file name has commas removed)", progname);
+    luinfo(dbg, "%s -b pattern   benchmark energy calculation", progname);
+    luinfo(dbg, "%s -g pattern   check the gradient and incremental energy", progname);
+    luinfo(dbg, "%s -x pattern.. compare time to relax for each solver pipeline", progname);
+    luinfo(dbg, "%s -R file [pattern..]  regression against a baseline csv (written if missing)", progname);
+    luinfo(dbg, "%s -i pattern   tension over a revolution from the influence matrix", progname);
+    luinfo(dbg, "%s -d file      describe a saved wheel", progname);
+    luinfo(dbg, "%s -w spec pattern  sweep parameters (eg r_hub=20:30:3,tension=800:1200:5)", progname);
+    luinfo(dbg, "%s -m spec pattern  monte carlo tolerances (eg n=1000,l_spoke=0.1,hub=0.05,rim=0.1)", progname);
+    luinfo(dbg, "options:");
+    luinfo(dbg, "  -s sd,nm      solver pipeline (from %s; default %s)", "sd,cg,bfgs2,newton,nm,cell,gs,ml", DEFAULT_PIPELINE);
+    luinfo(dbg, "  -t file.csv   write a trace of every relaxation iteration");
+    luinfo(dbg, "  -n            true by newton's method on spoke lengths");
+    luinfo(dbg, "  -P            deformation plots as one pdf page per scale (pattern-deform.pdf)");
+    luinfo(dbg, "  -c dir        cache trued wheels in dir");
+    luinfo(dbg, "  -j n          threads (for -w and -m, default all cpus; for gs, default 1)");
+    luinfo(dbg, "  -T spec       time budget in seconds, per run or per phase (eg 60 or true=30,deform=10,total=60)");
+    luinfo(dbg, "  -r n          (with -i) solve the n worst load positions in full");
+    luinfo(dbg, "  --profile file.json  time each phase (relax, true, deform, draw, png...)");
 }
 
 int main(int argc, char** argv) {
 
     LU_STATUS
+    int c, help = 0, benchmark = 0, gradient = 0, comparison = 0, rolling = 0, describe = 0, n_refine = 0;
+    const char *sweep_spec = NULL, *tolerance_spec = NULL, *budget = NULL, *baseline = NULL;
+    const char *pipeline = DEFAULT_PIPELINE, *profile = NULL;
+    options opts = {0};
 
     lulog_mkstderr(&dbg, lulog_level_debug);
-    if (argc != 2 || !strcmp("-h", argv[1])) {
+    LU_CHECK(profile_args(dbg, &argc, argv, &profile))
+    while ((c = getopt(argc, argv, "hbgxindPr:s:t:c:w:j:m:T:R:")) != -1) {
+        switch (c) {
+        case 'b':
+            benchmark = 1;
+            break;
+        case 'g':
+            gradient = 1;
+            break;
+        case 'x':
+            comparison = 1;
+            break;
+        case 'i':
+            rolling = 1;
+            break;
+        case 'r':
+            n_refine = atoi(optarg);
+            break;
+        case 'n':
+            opts.newton_true = 1;
+            break;
+        case 'P':
+            opts.pages = 1;
+            break;
+        case 'c':
+            opts.cache = optarg;
+            break;
+        case 'd':
+            describe = 1;
+            break;
+        case 'w':
+            sweep_spec = optarg;
+            break;
+        case 'm':
+            tolerance_spec = optarg;
+            break;
+        case 'j':
+            opts.n_threads = atoi(optarg);
+            break;
+        case 'T':
+            budget = optarg;
+            break;
+        case 'R':
+            baseline = optarg;
+            break;
+        case 's':
+            pipeline = optarg;
+            break;
+        case 't':
+            opts.trace = optarg;
+            break;
+        default:
+            help = 1;
+        }
+    }
+    if (help || (!baseline && optind == argc) || (!comparison && !baseline && optind != argc - 1)) {
         usage(argv[0]);
     } else {
+        LU_CHECK(spokes_alloc(dbg, 0, &ctx))
         LU_CHECK(set_handler())
-        LU_ASSERT(rng = gsl_rng_alloc(gsl_rng_mt19937), LU_ERR, dbg, "Could not create PRNG")
-        LU_CHECK(stress(argv[1]))
+        LU_CHECK(parse_pipeline(dbg, pipeline, &opts))
+        if (budget) LU_CHECK(parse_budget(dbg, budget, &opts))
+        // only a single stress (or roll) run writes wheel snapshots
+        opts.no_dump = baseline || tolerance_spec || comparison || benchmark || gradient;
+        if (baseline) {
+            LU_CHECK(regress(argc - optind, argv + optind, baseline, &opts))
+        } else if (tolerance_spec) {
+            LU_CHECK(run_tolerances(argv[optind], tolerance_spec, &opts))
+        } else if (sweep_spec) {
+            LU_CHECK(run_sweep(argv[optind], sweep_spec, &opts))
+        } else if (describe) {
+            LU_CHECK(describe_wheel(argv[optind]))
+        } else if (comparison) {
+            LU_CHECK(compare(argc - optind, argv + optind, &opts))
+        } else if (rolling) {
+            LU_CHECK(roll(argv[optind], &opts, n_refine))
+        } else if (benchmark) {
+            LU_CHECK(bench(argv[optind], &opts))
+        } else if (gradient) {
+            LU_CHECK(check_gradient(argv[optind], &opts))
+        } else {
+            LU_CHECK(stress(argv[optind], &opts))
+        }
     }
 
 LU_CLEANUP
+    status = spokes_free(ctx, status);
+    status = profile_write(dbg, profile, status);
     if (dbg) status = dbg->free(&dbg, status);
-    if (rng) gsl_rng_free(rng);
     return status;
 }
@@ -0,0 +1,66 @@
+
+#include <math.h>
+
+#include "lu/status.h"
+#include "lu/files.h"
+#include "lu/dynamic_memory.h"
+
+#include "trace.h"
+
+
+const char *phase_names[n_phase] = {"lace", "true", "deform"};
+
+double elapsed(struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + 1e-9 * (end.tv_nsec - start->tv_nsec);
+}
+
+int alloc_trace(lulog *log, const char *path, trace **t) {
+    LU_STATUS
+    LU_ALLOC(log, *t, 1)
+    if (path) {
+        LU_CHECK(lufle_open(log, path, "w", &(*t)->csv))
+        fprintf((*t)->csv, "relaxation,phase,solver,iteration,energy,gradient,size,elapsed\n");
+        luinfo(log, "Writing trace to %s", path);
+    }
+    LU_NO_CLEANUP
+}
+
+int free_trace(trace *t, int prev_status) {
+    if (t) {
+        if (t->csv) fclose(t->csv);
+        free(t);
+    }
+    return prev_status;
+}
+
+void trace_start(trace *t) {
+    t->n_relax++;
+    clock_gettime(CLOCK_MONOTONIC, &t->start);
+}
+
+// gradient or size are NAN if not used by the solver
+void trace_iteration(trace *t, const char *solver, int iter, double energy, double gradient, double size) {
+    if (t->csv) {
+        fprintf(t->csv, "%d,%s,%s,%d,%.12g,", t->n_relax, phase_names[t->phase], solver, iter, energy);
+        if (isnan(gradient)) fprintf(t->csv, ","); else fprintf(t->csv, "%g,", gradient);
+        if (isnan(size)) fprintf(t->csv, ","); else fprintf(t->csv, "%g,", size);
+        fprintf(t->csv, "%g\n", elapsed(&t->start));
+    }
+}
+
+void trace_end(trace *t, int iterations, long f_evals, long df_evals) {
+    t->relaxations[t->phase]++;
+    t->iterations[t->phase] += iterations;
+    t->f_evals[t->phase] += f_evals;
+    t->df_evals[t->phase] += df_evals;
+    t->seconds[t->phase] += elapsed(&t->start);
+}
+
+void trace_summary(lulog *log, trace *t) {
+    for (int i = 0; i < n_phase; ++i) {
+        luinfo(log, "Phase %s: %ld relaxations, %ld iterations, %ld f and %ld df evaluations in %.3fs",
+                phase_names[i], t->relaxations[i], t->iterations[i], t->f_evals[i], t->df_evals[i], t->seconds[i]);
+    }
+}
@@ -0,0 +1,44 @@
+
+#ifndef SPOKES_TRACE_H
+#define SPOKES_TRACE_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "lu/log.h"
+
+// convergence telemetry for relaxations.  every iteration can be written
+// to a csv file, and the number of function / gradient evaluations is
+// accumulated for each phase.
+
+typedef enum {
+    phase_lace,
+    phase_true,
+    phase_deform,
+    n_phase
+} phase;
+
+extern const char *phase_names[n_phase];
+
+typedef struct {
+    FILE *csv;                 // iteration trace (optional)
+    phase phase;               // current phase
+    int n_relax;               // relaxation calls so far (all phases)
+    struct timespec start;     // start of current relaxation
+    long relaxations[n_phase]; // per-phase totals
+    long iterations[n_phase];
+    long f_evals[n_phase];
+    long df_evals[n_phase];
+    double seconds[n_phase];
+} trace;
+
+double elapsed(struct timespec *start);
+
+int alloc_trace(lulog *log, const char *path, trace **t);
+int free_trace(trace *t, int prev_status);
+void trace_start(trace *t);
+void trace_iteration(trace *t, const char *solver, int iter, double energy, double gradient, double size);
+void trace_end(trace *t, int iterations, long f_evals, long df_evals);
+void trace_summary(lulog *log, trace *t);
+
+#endif
@@ -1,8 +1,14 @@
 
+#include <stdint.h>
 #include <math.h>
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #include "cairo/cairo.h"
+#include "cairo/cairo-pdf.h"
 
 #include "lu/status.h"
 #include "lu/log.h"
@@ -10,8 +16,10 @@
 #include "lu/strings.h"
 #include "lu/dynamic_memory.h"
 
+#include "codec.h"
 #include "wheel.h"
 #include "lib.h"
+#include "profile.h"
 
 
 int make_wheel(lulog *dbg, int *offsets, int length, int holes, int padding, char type, const char *pattern, wheel **wheel) {
@@ -107,8 +115,16 @@ xy xy_on_circle(double r, int hole, int n_holes) {
     return xy;
 }
 
-void draw_line_xy(cairo_t *cr, xy a, xy b) {
-    draw_line(cr, a.x, a.y, b.x, b.y);
+static void pen_line_xy(pen *p, xy a, xy b) {
+    pen_line(p, a.x, a.y, b.x, b.y);
+}
+
+// centre at (0,0), y up, with the rim filling most of the image
+static void plot_transform(wheel *wheel, int nx, int ny, double line_width, cairo_t *cr) {
+    cairo_translate(cr, nx/2, ny/2);
+    cairo_scale(cr, nx/(2.2 * wheel->r_rim), -ny/(2.2 * wheel->r_rim));
+    cairo_set_line_width(cr, line_width);
+    cairo_set_source_rgb(cr, 0, 0, 0);
 }
 
 void open_plot(wheel * wheel, int nx, int ny, double line_width, cairo_t **cr, cairo_surface_t **surface) {
@@ -119,82 +135,183 @@ void open_plot(wheel * wheel, int nx, int ny, double line_width, cairo_t **cr, c
     cairo_set_source_rgb(*cr, 1.0, 1.0, 1.0);
     cairo_paint(*cr);
 
-    cairo_translate(*cr, nx/2, ny/2);
-    cairo_scale(*cr, nx/(2.2 * wheel->r_rim), -ny/(2.2 * wheel->r_rim));
-
-    cairo_set_line_width(*cr, line_width);
-    cairo_set_source_rgb(*cr, 0, 0, 0);
+    plot_transform(wheel, nx, ny, line_width, *cr);
 }
 
 void close_plot(cairo_t *cr, cairo_surface_t *surface, const char *path) {
+    PROFILE_BEGIN(t);
     cairo_surface_write_to_png(surface, path);
+    PROFILE_END(t, probe_png);
     cairo_destroy(cr);
     cairo_surface_destroy(surface);
 }
 
-void draw_wheel(cairo_t *cr, wheel *wheel) {
+void draw_wheel(pen *p, wheel *wheel) {
     for (int hub = 0; hub < wheel->n_holes; ++hub) {
         int rim = wheel->hub_to_rim[hub];
-        draw_line_xy(cr, wheel->hub[hub], wheel->rim[rim]);
-        draw_line_xy(cr, wheel->hub[hub], wheel->hub[(hub+1) % wheel->n_holes]);
-        draw_line_xy(cr, wheel->rim[rim], wheel->rim[(rim+1) % wheel->n_holes]);
+        pen_line_xy(p, wheel->hub[hub], wheel->rim[rim]);
+        pen_line_xy(p, wheel->hub[hub], wheel->hub[(hub+1) % wheel->n_holes]);
+        pen_line_xy(p, wheel->rim[rim], wheel->rim[(rim+1) % wheel->n_holes]);
     }
+    pen_stroke(p);
 }
 
 void plot_wheel(wheel *wheel, const char *path) {
     cairo_surface_t *surface = NULL;
     cairo_t *cr = NULL;
+    PROFILE_BEGIN(t);
     open_plot(wheel, 500, 500, wheel->r_rim / 100, &cr, &surface);
-    draw_wheel(cr, wheel);
+    pen p = {cr, 0, 0};
+    draw_wheel(&p, wheel);
+    PROFILE_END(t, probe_draw);
     close_plot(cr, surface, path);
 }
 
-xy zoom(xy a, xy b, double scale) {
-    xy d = sub(b, a);
-    double r = sqrt(d.x * d.x + d.y * d.y), theta = atan2(d.y, d.x);
-    r *= scale;
-    d.x = r * cos(theta); d.y = r * sin(theta);
-    return add(a, d);
+// the deformations are tiny, so are plotted at each power of ten up to
+// 10^(N_SCALES-1).  the displacements are found once, the original wheel
+// is drawn once and painted under each scale, and the scales are drawn
+// and encoded on a thread each (cairo is fine with one cairo_t and
+// surface per thread, and the shared layer is only read).
+
+#define N_SCALES 6
+#define DEFORM_SIZE 500
+
+typedef struct {
+    wheel *original;
+    xy *d_hub;                  // deformed - original, per hole
+    xy *d_rim;
+    load *l;
+    cairo_surface_t *layer;     // the original wheel, shared
+    double scale;
+    const char *path;           // png (NULL when collected as pages)
+    cairo_surface_t *surface;
+} deform_plot;
+
+static xy scaled(xy a, xy d, double scale) {
+    return add(a, scalar_mult(scale, d));
 }
 
-void draw_deform(cairo_t *cr, wheel *a, wheel *b, double scale) {
-    for (int i = 0; i < a->n_holes; ++i) {
-        int j = a->hub_to_rim[i];
-        xy hub_a = a->hub[i], hub_b = b->hub[i];
-        xy rim1_a = a->rim[j], rim1_b = b->rim[j];
-        int k = (j + 1) % a->n_holes;
-        xy rim2_a = a->rim[k], rim2_b = b->rim[k];
-        draw_line_xy(cr, zoom(hub_a, hub_b, scale), zoom(rim1_a, rim1_b, scale));
-        draw_line_xy(cr, zoom(rim1_a, rim1_b, scale), zoom(rim2_a, rim2_b, scale));
+static void draw_deform(pen *p, deform_plot *dp) {
+    wheel *w = dp->original;
+    for (int i = 0; i < w->n_holes; ++i) {
+        int j = w->hub_to_rim[i], k = (j + 1) % w->n_holes;
+        xy hub = scaled(w->hub[i], dp->d_hub[i], dp->scale);
+        xy rim1 = scaled(w->rim[j], dp->d_rim[j], dp->scale);
+        xy rim2 = scaled(w->rim[k], dp->d_rim[k], dp->scale);
+        pen_line_xy(p, hub, rim1);
+        pen_line_xy(p, rim1, rim2);
     }
+    pen_stroke(p);
 }
 
-void plot_deform(wheel *original, wheel *deformed, load *l, const char *path, double scale) {
-    cairo_surface_t *surface = NULL;
-    cairo_t *cr = NULL;
-    open_plot(original, 500, 500, original->r_rim / 100, &cr, &surface);
-    cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
-    draw_wheel(cr, original);
-    cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
-    draw_deform(cr, original, deformed, scale);
+static void *deform_worker(void *arg) {
+    deform_plot *dp = arg;
+    wheel *w = dp->original;
+    PROFILE_BEGIN(t);
+    dp->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, DEFORM_SIZE, DEFORM_SIZE);
+    cairo_t *cr = cairo_create(dp->surface);
+    cairo_set_source_surface(cr, dp->layer, 0, 0);
+    cairo_paint(cr);
+    plot_transform(w, DEFORM_SIZE, DEFORM_SIZE, w->r_rim / 100, cr);
+    pen p = {cr, 0, 0};
+    draw_deform(&p, dp);
     cairo_set_source_rgb(cr, 0.5, 0.0, 0.0);
-    xy p = zoom(original->rim[l->i_rim], deformed->rim[l->i_rim], scale);
-    draw_line_xy(cr, p, add(p, scalar_mult(100, l->g_norm)));
-    close_plot(cr, surface, path);
+    xy r = scaled(w->rim[dp->l->i_rim], dp->d_rim[dp->l->i_rim], dp->scale);
+    pen_line_xy(&p, r, add(r, scalar_mult(100, dp->l->g_norm)));
+    pen_stroke(&p);
+    cairo_destroy(cr);
+    cairo_surface_flush(dp->surface);
+    PROFILE_END(t, probe_draw);
+    if (dp->path) {
+        PROFILE_BEGIN(u);
+        cairo_surface_write_to_png(dp->surface, dp->path);
+        PROFILE_END(u, probe_png);
+    }
+    return NULL;
 }
 
-int plot_multi_deform(lulog *dbg, wheel *original, wheel *deformed, load *l, const char *pattern) {
+// one page per scale, from the rendered images
+static int write_pages(lulog *dbg, deform_plot *dp, const char *path) {
     LU_STATUS
-    lustr path = {0};
-    for (int i = 0; i < 6; ++i) {
-        LU_CHECK(lustr_sprintf(dbg, &path, "%s-%d.png", pattern, i))
-        double scale = pow(10, i);
-        plot_deform(original, deformed, l, path.c, scale);
-        luinfo(dbg, "Scale %g plot: %s", scale, path.c);
-        LU_CHECK(lustr_clear(dbg, &path))
+    cairo_surface_t *pdf = NULL;
+    cairo_t *cr = NULL;
+    PROFILE_BEGIN(t);
+    pdf = cairo_pdf_surface_create(path, DEFORM_SIZE, DEFORM_SIZE);
+    cr = cairo_create(pdf);
+    for (int i = 0; i < N_SCALES; ++i) {
+        cairo_set_source_surface(cr, dp[i].surface, 0, 0);
+        cairo_paint(cr);
+        cairo_show_page(cr);
     }
+    LU_ASSERT(cairo_status(cr) == CAIRO_STATUS_SUCCESS, LU_ERR_IO, dbg, "Cannot write %s", path)
 LU_CLEANUP
-    status = lustr_free(&path, status);
+    if (cr) cairo_destroy(cr);
+    if (pdf) cairo_surface_destroy(pdf);
+    PROFILE_END(t, probe_png);
+    LU_RETURN
+}
+
+// pattern-0.png to pattern-5.png or, with pages, pattern-deform.pdf
+int plot_multi_deform(lulog *dbg, wheel *original, wheel *deformed, load *l, const char *pattern, int pages) {
+
+    LU_STATUS
+    int n = original->n_holes, n_started = 0;
+    lustr paths[N_SCALES] = {{0}}, pdf = {0};
+    deform_plot dp[N_SCALES] = {{0}};
+    pthread_t threads[N_SCALES];
+    xy *d = NULL;
+    cairo_surface_t *layer = NULL;
+    cairo_t *cr = NULL;
+
+    LU_ALLOC(dbg, d, 2 * n)
+    for (int i = 0; i < n; ++i) {
+        d[i] = sub(deformed->hub[i], original->hub[i]);
+        d[n + i] = sub(deformed->rim[i], original->rim[i]);
+    }
+
+    PROFILE_BEGIN(t);
+    open_plot(original, DEFORM_SIZE, DEFORM_SIZE, original->r_rim / 100, &cr, &layer);
+    pen p = {cr, 0, 0};
+    cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
+    draw_wheel(&p, original);
+    cairo_destroy(cr); cr = NULL;
+    cairo_surface_flush(layer);
+    PROFILE_END(t, probe_draw);
+    LU_ASSERT(cairo_surface_status(layer) == CAIRO_STATUS_SUCCESS, LU_ERR_MEM, dbg, "Cannot create surface")
+
+    for (int i = 0; i < N_SCALES; ++i) {
+        dp[i] = (deform_plot){original, d, d + n, l, layer, pow(10, i), NULL, NULL};
+        if (!pages) {
+            LU_CHECK(lustr_sprintf(dbg, &paths[i], "%s-%d.png", pattern, i))
+            dp[i].path = paths[i].c;
+        }
+    }
+    for (; n_started < N_SCALES; ++n_started) {
+        LU_ASSERT(!pthread_create(&threads[n_started], NULL, deform_worker, &dp[n_started]),
+                LU_ERR, dbg, "Cannot create thread")
+    }
+    for (; n_started; --n_started) pthread_join(threads[n_started-1], NULL);
+    for (int i = 0; i < N_SCALES; ++i) {
+        LU_ASSERT(cairo_surface_status(dp[i].surface) == CAIRO_STATUS_SUCCESS, LU_ERR_MEM, dbg,
+                "Cannot draw scale %g", dp[i].scale)
+        if (!pages) luinfo(dbg, "Scale %g plot: %s", dp[i].scale, dp[i].path);
+    }
+    if (pages) {
+        LU_CHECK(lustr_sprintf(dbg, &pdf, "%s-deform.pdf", pattern))
+        LU_CHECK(write_pages(dbg, dp, pdf.c))
+        luinfo(dbg, "Scales %g to %g plot: %s", dp[0].scale, dp[N_SCALES-1].scale, pdf.c);
+    }
+
+LU_CLEANUP
+    for (; n_started; --n_started) pthread_join(threads[n_started-1], NULL);
+    for (int i = 0; i < N_SCALES; ++i) {
+        if (dp[i].surface) cairo_surface_destroy(dp[i].surface);
+        status = lustr_free(&paths[i], status);
+    }
+    status = lustr_free(&pdf, status);
+    if (cr) cairo_destroy(cr);
+    if (layer) cairo_surface_destroy(layer);
+    free(d);
     LU_RETURN
 }
 
@@ -211,7 +328,7 @@ void print_wheel(lulog *dbg, wheel *w, FILE *f) {
     for (int i = 0; i < w->n_holes; ++i) {
         int j = w->hub_to_rim[i];
         double l = length(sub(w->hub[i], w->rim[j]));
-        fprintf(f, "  %d %g,%g -> %g,%g %d  %g/%g = %g\n",
+        fprintf(f, "  %d %g,%g -> %d %g,%g  %g/%g = %g\n",
                 i, w->hub[i].x, w->hub[i].y, j, w->rim[j].x, w->rim[j].y,
                 l, w->l_spoke[i],
                 w->e_spoke * (l - w->l_spoke[i]) / w->l_spoke[i]);
@@ -220,7 +337,7 @@ void print_wheel(lulog *dbg, wheel *w, FILE *f) {
     for (int i = 0; i < w->n_holes; ++i) {
         int j = (i + 1) % w->n_holes;
         double l = length(sub(w->rim[i], w->rim[j]));
-        fprintf(f, "  %d %g,%g -> %g,%g %d  %g/%g = %g\n",
+        fprintf(f, "  %d %g,%g -> %d %g,%g  %g/%g = %g\n",
                 i, w->rim[i].x, w->rim[i].y, j, w->rim[j].x, w->rim[j].y,
                 l, w->l_chord,
                 w->e_rim * (l - w->l_chord) / w->l_chord);
@@ -228,15 +345,142 @@ void print_wheel(lulog *dbg, wheel *w, FILE *f) {
     fprintf(f, " e: %g spoke, %g rim; target %g\n", w->e_spoke, w->e_rim, w->tension);
 }
 
-int dump_wheel(lulog *dbg, wheel *w, const char *desc) {
+// binary snapshots, in native byte order (for the local cache, not for
+// exchange).
+
+#define WHEEL_MAGIC "SPKW"
+#define WHEEL_VERSION 1
+#define WHEEL_MAX_HOLES 1024  // sanity check when reading
+
+#define WRITE(x, n) LU_ASSERT(fwrite(x, sizeof(*(x)), n, file) == (n), LU_ERR_IO, dbg, "Cannot write %s", path)
+#define READ(x, n) LU_ASSERT(fread(x, sizeof(*(x)), n, file) == (n), LU_ERR_IO, dbg, "Cannot read %s", path)
+
+// written to a temporary file and renamed into place, so that a reader
+// (another spokesd worker, say) never sees a partial wheel.
+int write_wheel(lulog *dbg, wheel *w, const char *path) {
     LU_STATUS
     FILE *file = NULL;
-    lustr path = {0};
-    LU_CHECK(lustr_sprintf(dbg, &path, "%s-%s.txt", w->pattern, desc))
-    LU_CHECK(lufle_open(dbg, path.c, "w", &file))
-    print_wheel(dbg, w, file);
+    lustr tmp = {0};
+    int version = WHEEL_VERSION, n_pattern = strlen(w->pattern), fd = -1, created = 0;
+    LU_CHECK(lustr_sprintf(dbg, &tmp, "%s.XXXXXX", path))
+    LU_ASSERT((fd = mkstemp(tmp.c)) >= 0, LU_ERR_IO, dbg, "Cannot create %s", tmp.c)
+    created = 1;
+    fchmod(fd, 0644);  // mkstemp() is private
+    LU_ASSERT(file = fdopen(fd, "wb"), LU_ERR_IO, dbg, "Cannot open %s", tmp.c)
+    fd = -1;
+    WRITE(WHEEL_MAGIC, 4)
+    WRITE(&version, 1)
+    WRITE(&n_pattern, 1)
+    WRITE(w->pattern, n_pattern)
+    WRITE(&w->type, 1)
+    WRITE(&w->n_offsets, 1)
+    WRITE(w->offset, w->n_offsets)
+    WRITE(&w->align, 1)
+    WRITE(&w->n_holes, 1)
+    WRITE(&w->r_hub, 1)
+    WRITE(&w->r_rim, 1)
+    WRITE(&w->l_chord, 1)
+    WRITE(&w->tension, 1)
+    WRITE(&w->e_rim, 1)
+    WRITE(&w->e_spoke, 1)
+    WRITE(w->rim, w->n_holes)
+    WRITE(w->hub, w->n_holes)
+    WRITE(w->hub_to_rim, w->n_holes)
+    WRITE(w->rim_to_hub, w->n_holes)
+    WRITE(w->l_spoke, w->n_holes)
+    LU_ASSERT(!fclose(file), LU_ERR_IO, dbg, "Cannot write %s", tmp.c)
+    file = NULL;
+    LU_ASSERT(!rename(tmp.c, path), LU_ERR_IO, dbg, "Cannot rename %s to %s", tmp.c, path)
+LU_CLEANUP
+    if (file) fclose(file);
+    if (fd >= 0) close(fd);
+    if (status && created) unlink(tmp.c);
+    status = lustr_free(&tmp, status);
+    LU_RETURN
+}
+
+int read_wheel(lulog *dbg, const char *path, wheel **w) {
+    LU_STATUS
+    FILE *file = NULL;
+    char magic[4];
+    int version, n_pattern;
+    LU_CHECK(lufle_open(dbg, path, "rb", &file))
+    READ(magic, 4)
+    LU_ASSERT(!strncmp(magic, WHEEL_MAGIC, 4), LU_ERR_IO, dbg, "%s is not a wheel", path)
+    READ(&version, 1)
+    LU_ASSERT(version == WHEEL_VERSION, LU_ERR_IO, dbg, "%s has version %d (not %d)", path, version, WHEEL_VERSION)
+    LU_ALLOC(dbg, *w, 1)
+    READ(&n_pattern, 1)
+    LU_ASSERT(n_pattern > 0 && n_pattern < PACKED_MAX_NAME, LU_ERR_IO, dbg, "Bad pattern length in %s", path)
+    LU_ALLOC(dbg, (*w)->pattern, n_pattern + 1)
+    READ((*w)->pattern, n_pattern)
+    READ(&(*w)->type, 1)
+    READ(&(*w)->n_offsets, 1)
+    LU_ASSERT((*w)->n_offsets > 0 && (*w)->n_offsets <= PACKED_MAX_LENGTH, LU_ERR_IO, dbg,
+            "Bad number of offsets in %s", path)
+    LU_ALLOC(dbg, (*w)->offset, (*w)->n_offsets)
+    READ((*w)->offset, (*w)->n_offsets)
+    READ(&(*w)->align, 1)
+    READ(&(*w)->n_holes, 1)
+    READ(&(*w)->r_hub, 1)
+    READ(&(*w)->r_rim, 1)
+    READ(&(*w)->l_chord, 1)
+    READ(&(*w)->tension, 1)
+    READ(&(*w)->e_rim, 1)
+    READ(&(*w)->e_spoke, 1)
+    int n = (*w)->n_holes;
+    LU_ASSERT(n > 0 && n <= WHEEL_MAX_HOLES, LU_ERR_IO, dbg, "Bad number of holes in %s", path)
+    LU_ALLOC(dbg, (*w)->rim, n)
+    LU_ALLOC(dbg, (*w)->hub, n)
+    LU_ALLOC(dbg, (*w)->hub_to_rim, n)
+    LU_ALLOC(dbg, (*w)->rim_to_hub, n)
+    LU_ALLOC(dbg, (*w)->l_spoke, n)
+    READ((*w)->rim, n)
+    READ((*w)->hub, n)
+    READ((*w)->hub_to_rim, n)
+    READ((*w)->rim_to_hub, n)
+    READ((*w)->l_spoke, n)
+    for (int i = 0; i < n; ++i) {
+        LU_ASSERT((*w)->hub_to_rim[i] >= 0 && (*w)->hub_to_rim[i] < n && (*w)->rim_to_hub[i] >= 0
+                && (*w)->rim_to_hub[i] < n, LU_ERR_IO, dbg, "Bad spoke index in %s", path)
+    }
 LU_CLEANUP
     if (file) fclose(file);
+    if (status) {free_wheel(*w); *w = NULL;}
+    LU_RETURN
+}
+
+// fnv-1a over the parameters that determine the trued wheel
+uint64_t wheel_key(wheel *w) {
+    uint64_t h = 14695981039346656037ULL;
+    h = hash_bytes(h, w->pattern, strlen(w->pattern) + 1);
+    h = hash_bytes(h, &w->n_holes, sizeof(w->n_holes));
+    h = hash_bytes(h, &w->r_hub, sizeof(w->r_hub));
+    h = hash_bytes(h, &w->r_rim, sizeof(w->r_rim));
+    h = hash_bytes(h, &w->tension, sizeof(w->tension));
+    h = hash_bytes(h, &w->e_spoke, sizeof(w->e_spoke));
+    h = hash_bytes(h, &w->e_rim, sizeof(w->e_rim));
+    return h;
+}
+
+// true if a cached wheel is for the same parameters as w (in case of
+// hash collision)
+int same_wheel(wheel *a, wheel *b) {
+    return !strcmp(a->pattern, b->pattern) && a->n_holes == b->n_holes
+            && a->r_hub == b->r_hub && a->r_rim == b->r_rim && a->tension == b->tension
+            && a->e_spoke == b->e_spoke && a->e_rim == b->e_rim;
+}
+
+int cache_path(lulog *dbg, const char *dir, wheel *w, lustr *path) {
+    return lustr_sprintf(dbg, path, "%s/%016llx.wheel", dir, (unsigned long long)wheel_key(w));
+}
+
+int dump_wheel(lulog *dbg, wheel *w, const char *desc) {
+    LU_STATUS
+    lustr path = {0};
+    LU_CHECK(lustr_sprintf(dbg, &path, "%s-%s.wheel", w->pattern, desc))
+    LU_CHECK(write_wheel(dbg, w, path.c))
+LU_CLEANUP
     status = lustr_free(&path, status);
     LU_RETURN
 }
@@ -2,6 +2,15 @@
 #ifndef SPOKES_WHEEL_H
 #define SPOKES_WHEEL_H
 
+#include <stdio.h>
+
+#include "cairo/cairo.h"
+
+#include "lu/log.h"
+#include "lu/strings.h"
+
+#include "lib.h"
+
 typedef struct {
     double x;
     double y;
@@ -49,11 +58,16 @@ xy xy_on_circle(double r, int hole, int n_holes);
 
 void open_plot(wheel *wheel, int nx, int ny, double line_width, cairo_t **cr, cairo_surface_t **surface);
 void close_plot(cairo_t *cr, cairo_surface_t *surface, const char *path);
+void draw_wheel(pen *p, wheel *wheel);
 
 void plot_wheel(wheel *wheel, const char *path);
-void plot_deform(wheel *original, wheel *deformed, load *l, const char *path, double scale);
-int plot_multi_deform(lulog *dbg, wheel *original, wheel *deformed, load *l, const char *pattern);
+int plot_multi_deform(lulog *dbg, wheel *original, wheel *deformed, load *l, const char *pattern, int pages);
 
+void print_wheel(lulog *dbg, wheel *w, FILE *f);
+int write_wheel(lulog *dbg, wheel *w, const char *path);
+int read_wheel(lulog *dbg, const char *path, wheel **w);
+int same_wheel(wheel *a, wheel *b);
+int cache_path(lulog *dbg, const char *dir, wheel *w, lustr *path);
 int dump_wheel(lulog *dbg, wheel *w, const char *desc);
 
 #endif